@@ -0,0 +1,143 @@
+// analysis.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <pthread.h>
+#include <unistd.h>
+#include "analysis.h"
+#include "bands.h"
+#include "stats.h"
+
+ring_t hop_ring, pixel_ring;
+
+// Worker state
+static pthread_t worker;
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake_cond = PTHREAD_COND_INITIALIZER;
+static int running;
+static unsigned int tone_lanes, channel_count;
+static const patch_t * heard;
+
+// Publish one decoded pixel. The GUI loop is the only consumer; wait for
+// it rather than drop. Returns -1 if we were stopped while waiting.
+static int emit_pixel(const patch_t * p, unsigned int channel, unsigned int index, float f, float peak) {
+	pixel_t * px;
+	while ((px = (pixel_t *) ring_write_slot(&pixel_ring)) == NULL && __atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+		usleep(1000);
+	}
+	if (px == NULL) {
+		return -1;
+	}
+	px->index = index;
+	px->channel = channel;
+	px->image = p->image;
+	decode_hsl(f, peak, p->settings.pitch_scale, p->settings.lower_bounds, &px->h, &px->l);
+	ring_commit(&pixel_ring);
+	return 0;
+}
+
+// Decode every hop waiting in `hop_ring`
+static void drain_hops() {
+	hop_t * hop;
+	float freqs[MAX_LANES], amps[MAX_LANES];
+	unsigned int c, l;
+	while ((hop = (hop_t *) ring_read_slot(&hop_ring)) != NULL) {
+		uint64_t start = stats_now();
+		// The patch outlives every hop that points at it; see control.c
+		detector_t * detector = &hop->patch->detector;
+		const settings_t * s = &hop->patch->settings;
+		unsigned int frames = hopclock_frames(&hop->patch->clock);
+		for (c = 0; c < channel_count; c++) {
+			const sample_t * data = hop->data + c * frames;
+			if (tone_lanes == 1) {
+				if (emit_pixel(hop->patch, c, hop->index, detector_pitch(detector, data), hop->peak[c]) != 0) {
+					return;
+				}
+				continue;
+			}
+			// Each lane carries its own amplitude, scaled down by `lanes`
+			// in tone_table_entry()
+			detector_bands(detector, data, tone_lanes, freqs, amps);
+			for (l = 0; l < tone_lanes; l++) {
+				float f = band_unspread(freqs[l], l, tone_lanes, s->pitch_scale, s->lower_bounds);
+				if (emit_pixel(hop->patch, c, hop->index * tone_lanes + l, f, amps[l] * tone_lanes) != 0) {
+					return;
+				}
+			}
+		}
+		// Includes any wait for the GUI to make room for pixels
+		stats_record(StatHop, stats_now() - start);
+		__atomic_store_n(&heard, hop->patch, __ATOMIC_RELEASE);
+		ring_release(&hop_ring);
+	}
+}
+
+static void * analysis_main(void * arg) {
+	pthread_mutex_lock(&wake_lock);
+	while (running) {
+		pthread_mutex_unlock(&wake_lock);
+		drain_hops();
+		pthread_mutex_lock(&wake_lock);
+		if (running && ring_fill(&hop_ring) == 0) {
+			pthread_cond_wait(&wake_cond, &wake_lock);
+		}
+	}
+	pthread_mutex_unlock(&wake_lock);
+	return NULL;
+}
+
+int analysis_start(unsigned int sample_rate, unsigned int hop_frames, unsigned int max_hop_frames,
+		unsigned int lanes, unsigned int channels) {
+	// Half a second of hops in flight, either way
+	unsigned int slots = sample_rate / 2 / hop_frames;
+	if (slots < 16) {
+		slots = 16;
+	}
+	if (ring_init(&hop_ring, slots, sizeof(hop_t) + channels * max_hop_frames * sizeof(sample_t)) != 0 ||
+			ring_init(&pixel_ring, slots * lanes * channels, sizeof(pixel_t)) != 0) {
+		return -1;
+	}
+	tone_lanes = lanes;
+	channel_count = channels;
+	heard = NULL;
+	running = 1;
+	return pthread_create(&worker, NULL, analysis_main, NULL);
+}
+
+// Like JACK's capture_client example: never block the caller. If the
+// worker holds the lock it is awake already, or will look again on the
+// next hop.
+void analysis_wake() {
+	if (pthread_mutex_trylock(&wake_lock) == 0) {
+		pthread_cond_signal(&wake_cond);
+		pthread_mutex_unlock(&wake_lock);
+	}
+}
+
+const patch_t * analysis_patch() {
+	return __atomic_load_n(&heard, __ATOMIC_ACQUIRE);
+}
+
+void analysis_stop() {
+	pthread_mutex_lock(&wake_lock);
+	__atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+	pthread_cond_signal(&wake_cond);
+	pthread_mutex_unlock(&wake_lock);
+	pthread_join(worker, NULL);
+	ring_free(&hop_ring);
+	ring_free(&pixel_ring);
+}
@@ -0,0 +1,66 @@
+// analysis.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// The analysis worker. process() captures each hop of incoming audio into
+// `hop_ring`; the worker runs pitch detection on it and publishes the
+// decoded pixel into `pixel_ring`, which the GUI loop drains into
+// dest_image. Only the worker touches the pitch detector of each patch.
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include "sonify.h"
+#include "ring.h"
+#include "detector.h"
+#include "patch.h"
+
+#define MAX_CHANNELS 16
+
+// One hop of captured input, from every channel
+typedef struct {
+	unsigned int index;		// hop number; its first pixel is index * lanes
+	patch_t * patch;		// played with, and to be heard with
+	sample_t peak[MAX_CHANNELS];
+	sample_t data[];		// hopclock_frames() of the patch's clock per channel, back to back
+} hop_t;
+
+// One decoded pixel, as hue and lightness; the GUI loop converts them to
+// RGB a batch at a time
+typedef struct {
+	unsigned int index;		// within its channel's stripe
+	unsigned int channel;
+	image_t * image;		// decoded from
+	float h, l;
+} pixel_t;
+
+extern ring_t hop_ring, pixel_ring;
+
+// Allocate both rings and start the worker. The hop ring holds half a
+// second of `hop_frames` hops, each room for up to `max_hop_frames`
+// frames. Each hop carries `lanes` pixels (see bands.h) on each of
+// `channels` inputs. Returns 0 on success.
+int analysis_start(unsigned int sample_rate, unsigned int hop_frames, unsigned int max_hop_frames,
+		unsigned int lanes, unsigned int channels);
+// Tell the worker a hop is waiting. Safe to call from process().
+void analysis_wake();
+void analysis_stop();
+
+// The patch of the last hop the worker finished with. Hops are heard in
+// order, so once this is a new patch no hop needs an older one.
+const patch_t * analysis_patch();
+
+#endif
@@ -0,0 +1,51 @@
+// bands.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// Multi-tone mode: `lanes` pixels play at once, each in its own sub-band
+// of [lower_bounds, lower_bounds + pitch_scale]. Lane k of each group
+// carries its hue within band k, leaving BAND_GUARD of the band empty on
+// either side so neighbours do not blur into each other.
+#ifndef BANDS_H
+#define BANDS_H
+
+#define BAND_GUARD 0.1f
+#define MAX_LANES 64
+
+// Edges of sub-band `lane`, in Hz
+static inline void band_edges(int lane, int lanes, int pitch_scale, int lower_bounds, float * lo, float * hi) {
+	float width = (float) pitch_scale / lanes;
+	*lo = lower_bounds + lane * width;
+	*hi = *lo + width;
+}
+
+// Frequency for `hue` in sub-band `lane`
+static inline float band_tone(float hue, int lane, int lanes, int pitch_scale, int lower_bounds) {
+	float lo, hi;
+	band_edges(lane, lanes, pitch_scale, lower_bounds, &lo, &hi);
+	return lo + (hi - lo) * (BAND_GUARD + (1 - 2 * BAND_GUARD) * hue);
+}
+
+// The frequency a single-tone transmission would have used for what was
+// heard at `f` in sub-band `lane`, so Sound2Hsl() can decode it as usual
+static inline float band_unspread(float f, int lane, int lanes, int pitch_scale, int lower_bounds) {
+	float lo, hi;
+	band_edges(lane, lanes, pitch_scale, lower_bounds, &lo, &hi);
+	return lower_bounds + pitch_scale * (((f - lo) / (hi - lo) - BAND_GUARD) / (1 - 2 * BAND_GUARD));
+}
+
+#endif
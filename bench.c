@@ -0,0 +1,346 @@
+// bench.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// sonify-bench: drive the engine (engine.h) from a loop instead of JACK,
+// one callback of `nframes` after another on a synthetic clock, for every
+// waveform at 1, 5 and 10 ms hops. Input is our own output (a loopback
+// with no latency) or an audio file. After each callback we wait for the
+// analysis worker to catch up, outside the timed region, so no hop is
+// dropped and every run decodes the same pixels.
+#include <dlfcn.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sndfile.h>
+// 
+#include "sonify.h"
+#include "engine.h"
+#include "tones.h"
+#include "image.h"
+#include "wavebank.h"
+#include "render.h"
+#include "analysis.h"
+#include "detector.h"
+#include "bands.h"
+#include "stats.h"
+
+// Allocation counting | Our own malloc() and friends, passed through to
+// the real ones found with dlsym(). Only calls made from this thread
+// while `counting` is set are counted, so the workers do not show up.
+static __thread int counting = 0;
+static unsigned long allocations = 0;
+// --feedback | Decoded pixels go back into the tone table, as in sonify
+static feedback_t * feedback = NULL;
+static void * (*real_malloc)(size_t);
+static void * (*real_calloc)(size_t, size_t);
+static void * (*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+// dlsym() may itself call calloc(); serve that from here
+static char bootstrap[4096];
+static size_t bootstrap_used = 0;
+
+static void resolve() {
+	static int resolving = 0;
+	if (resolving) {
+		return;
+	}
+	resolving = 1;
+	real_malloc = (void * (*)(size_t)) dlsym(RTLD_NEXT, "malloc");
+	real_calloc = (void * (*)(size_t, size_t)) dlsym(RTLD_NEXT, "calloc");
+	real_realloc = (void * (*)(void *, size_t)) dlsym(RTLD_NEXT, "realloc");
+	real_free = (void (*)(void *)) dlsym(RTLD_NEXT, "free");
+	resolving = 0;
+}
+
+void * malloc(size_t n) {
+	if (real_malloc == NULL) {
+		resolve();
+	}
+	if (counting) {
+		allocations++;
+	}
+	return real_malloc(n);
+}
+
+void * calloc(size_t n, size_t size) {
+	if (real_calloc == NULL) {
+		resolve();
+		if (real_calloc == NULL) {
+			size_t want = (n * size + 15) & ~(size_t) 15;
+			void * p = bootstrap + bootstrap_used;
+			if (bootstrap_used + want > sizeof(bootstrap)) {
+				return NULL;
+			}
+			bootstrap_used += want;
+			return p;
+		}
+	}
+	if (counting) {
+		allocations++;
+	}
+	return real_calloc(n, size);
+}
+
+void * realloc(void * p, size_t n) {
+	if (real_realloc == NULL) {
+		resolve();
+	}
+	if (counting) {
+		allocations++;
+	}
+	return real_realloc(p, n);
+}
+
+void free(void * p) {
+	if ((char *) p >= bootstrap && (char *) p < bootstrap + sizeof(bootstrap)) {
+		return;
+	}
+	if (real_free == NULL) {
+		resolve();
+	}
+	real_free(p);
+}
+
+// Results of one run
+typedef struct {
+	double hue_err, light_err;
+	unsigned long pixels;
+} errors_t;
+
+static int compare_ns(const void * a, const void * b) {
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+	return x < y ? -1 : x > y;
+}
+
+// Score every pixel the worker has decoded against what was played
+static void drain_pixels(const tone_table_t * table, errors_t * err) {
+	pixel_t * px;
+	float hue, amp;
+	while ((px = (pixel_t *) ring_read_slot(&pixel_ring)) != NULL) {
+		unsigned int i = px->channel * table->stripe + px->index % table->stripe;
+		tone_table_source(table, i, &hue, &amp);
+		float dh = fmodf(fabsf(px->h - hue), 1);
+		err->hue_err += dh > 0.5f ? 1 - dh : dh;
+		err->light_err += fabsf(px->l - (1 - amp));
+		err->pixels++;
+		if (feedback != NULL) {
+			feedback_write(feedback, px->channel, i, px->h, px->l);
+		}
+		ring_release(&pixel_ring);
+	}
+}
+
+// Wait for the worker to take every hop we have handed it
+static void catch_up(const tone_table_t * table, errors_t * err) {
+	while (ring_fill(&hop_ring) > 0) {
+		drain_pixels(table, err);
+		// A wake can be missed while the worker holds its lock; JACK would
+		// send another with the next hop, but we are waiting for it
+		analysis_wake();
+		usleep(50);
+	}
+	drain_pixels(table, err);
+}
+
+int main(int argc, char * argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: sonify-bench <image path> [freq scale] [lowest freq] [--nframes <n>] [--rate <hz>] [--seconds <s>] [--input <audio file>] [--detector <fcomb | fft>] [--tones <n>] [--channels <n>] [--feedback]\ni.e. sonify-bench img.png 10000 1000 --nframes 256\n");
+		exit(1);
+	}
+	int pitch_scale = 10000, lower_bounds = 1000;
+	unsigned int nframes = 256, sample_rate = 44100;
+	float seconds = 5;
+	const char * input_path = NULL;
+	enum METHOD method = Fcomb;
+	int tone_lanes = 1, channels = 1, feedback_mode = 0;
+	const char * types[] = { "sin", "sq", "tri", "saw" };
+	const float ms_times[] = { 0.5, 1, 5, 10 };
+	int i, t, h, c, positional = 0;
+	for (i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "--nframes")==0 && i + 1 < argc) {
+			nframes = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--rate")==0 && i + 1 < argc) {
+			sample_rate = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--seconds")==0 && i + 1 < argc) {
+			seconds = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--input")==0 && i + 1 < argc) {
+			input_path = argv[++i];
+		} else if (strcmp(argv[i], "--detector")==0 && i + 1 < argc && parse_method(argv[i + 1]) >= 0) {
+			method = parse_method(argv[++i]);
+		} else if (strcmp(argv[i], "--tones")==0 && i + 1 < argc) {
+			tone_lanes = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--channels")==0 && i + 1 < argc) {
+			channels = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--feedback")==0) {
+			feedback_mode = 1;
+		} else if (argv[i][0] != '-' && positional < 2) {
+			if (positional++ == 0) {
+				pitch_scale = atoi(argv[i]);
+			} else {
+				lower_bounds = atoi(argv[i]);
+			}
+		} else {
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			exit(1);
+		}
+	}
+	if (nframes < 1 || sample_rate < 1 || seconds <= 0 || tone_lanes < 1 || tone_lanes > MAX_LANES ||
+			channels < 1 || channels > MAX_CHANNELS) {
+		fprintf(stderr, "bad option value\n");
+		exit(1);
+	}
+	// Only the FFT estimator can pull several tones out of one hop
+	if (tone_lanes > 1) {
+		method = Fft;
+	}
+
+	// Image
+	image_t image;
+	tone_table_t tone_table;
+	if (image_open(&image, argv[1], NULL, 1, 0) != 0) {
+		exit(1);
+	}
+	if (tone_table_init(&tone_table, &image.map, channels, tone_lanes, pitch_scale, lower_bounds) == 0) {
+		fprintf(stderr, "image too small for %d channels\n", channels);
+		exit(1);
+	}
+
+	// Input, if not a loopback: the whole file, looped to fill each callback
+	sample_t * recorded = NULL;
+	sf_count_t recorded_frames = 0;
+	int recorded_channels = 1;
+	if (input_path != NULL) {
+		SF_INFO info;
+		memset(&info, 0, sizeof(SF_INFO));
+		SNDFILE * in = sf_open(input_path, SFM_READ, &info);
+		if (in == NULL) {
+			fprintf(stderr, "cannot open %s: %s\n", input_path, sf_strerror(NULL));
+			exit(1);
+		}
+		recorded_channels = info.channels;
+		recorded = (sample_t *) malloc((size_t) info.frames * info.channels * sizeof(sample_t));
+		if (recorded == NULL) {
+			fprintf(stderr,"memory allocation failed\n");
+			exit(3);
+		}
+		recorded_frames = sf_readf_float(in, recorded, info.frames);
+		sf_close(in);
+		if (recorded_frames < 1) {
+			fprintf(stderr, "%s is empty\n", input_path);
+			exit(1);
+		}
+	}
+	sample_t * out[MAX_CHANNELS], * in[MAX_CHANNELS];
+	for (c = 0; c < channels; c++) {
+		out[c] = (sample_t *) malloc(nframes * sizeof(sample_t));
+		in[c] = input_path == NULL ? out[c] : (sample_t *) malloc(nframes * sizeof(sample_t));
+		if (out[c] == NULL || in[c] == NULL) {
+			fprintf(stderr,"memory allocation failed\n");
+			exit(3);
+		}
+	}
+
+	printf("render kernels: %s\n", render_init());
+	printf("%s: %u x %u, %d channel(s), %d tone(s); %u frames per callback at %u Hz; input %s\n", argv[1],
+			image.map.width, image.map.height, channels, tone_lanes, nframes, sample_rate,
+			input_path != NULL ? input_path : "loopback");
+	printf("%-4s %5s %10s %10s %10s %10s %10s %10s %10s\n", "wave", "ms", "ns/frame", "p50 ns", "p99 ns", "p99.9 ns",
+			"allocs/cb", "hue err %", "L err %");
+	for (t = 0; t < 4; t++) {
+		for (h = 0; h < 4; h++) {
+			hopclock_t clock;
+			unsigned int hop_frames;
+			unsigned long long frames, position = 0;
+			unsigned long callbacks, k;
+			uint64_t * ns, total = 0, start;
+			settings_t settings = { pitch_scale, lower_bounds, ms_times[h], (enum TYPE) t, method };
+			patch_t patch;
+			engine_t engine;
+			errors_t err = { 0, 0, 0 };
+			hopclock_init(&clock, sample_rate, ms_times[h]);
+			hop_frames = hopclock_frames(&clock);
+			// One pass over the image, or `seconds` of audio if that is less.
+			// Feedback runs go round again, to play what they heard.
+			frames = hopclock_offset(&clock, tone_table.count / (channels * tone_lanes));
+			if (frames > seconds * sample_rate || feedback_mode) {
+				frames = seconds * sample_rate;
+			}
+			callbacks = (frames + nframes - 1) / nframes;
+			if (callbacks == 0) {
+				callbacks = 1;
+			}
+			ns = (uint64_t *) malloc(callbacks * sizeof(uint64_t));
+			if (ns == NULL) {
+				fprintf(stderr,"memory allocation failed\n");
+				exit(3);
+			}
+			// Every run starts again from the image
+			if (feedback_mode) {
+				if (feedback_init(&image.feedback, &image.map, channels) != 0) {
+					fprintf(stderr,"memory allocation failed\n");
+					exit(3);
+				}
+				image.feedback_mode = 1;
+				feedback = &image.feedback;
+			}
+			if (patch_build(&patch, &settings, &image, channels, tone_lanes, sample_rate) != 0) {
+				exit(1);
+			}
+			if (analysis_start(sample_rate, hop_frames, hop_frames, tone_lanes, channels) != 0) {
+				fprintf(stderr, "cannot start analysis worker\n");
+				exit(1);
+			}
+			engine_init(&engine, &patch);
+			allocations = 0;
+			for (k = 0; k < callbacks; k++) {
+				if (recorded != NULL) {
+					for (i = 0; i < (int) nframes; i++, position++) {
+						sf_count_t f = position % recorded_frames;
+						for (c = 0; c < channels; c++) {
+							in[c][i] = recorded[f * recorded_channels + c % recorded_channels];
+						}
+					}
+				}
+				counting = 1;
+				start = stats_now();
+				engine_process(&engine, in, out, nframes);
+				ns[k] = stats_now() - start;
+				counting = 0;
+				total += ns[k];
+				catch_up(&patch.table, &err);
+			}
+			analysis_stop();
+			patch_free(&patch);
+			if (feedback_mode) {
+				feedback_free(&image.feedback);
+				image.feedback_mode = 0;
+			}
+			qsort(ns, callbacks, sizeof(uint64_t), compare_ns);
+			printf("%-4s %5g %10.2f %10llu %10llu %10llu %10.3f %10.3f %10.3f\n", types[t], ms_times[h],
+					(double) total / (callbacks * nframes),
+					(unsigned long long) ns[callbacks / 2], (unsigned long long) ns[callbacks * 99 / 100],
+					(unsigned long long) ns[callbacks * 999 / 1000], (double) allocations / callbacks,
+					err.pixels ? 100 * err.hue_err / err.pixels : 0, err.pixels ? 100 * err.light_err / err.pixels : 0);
+			free(ns);
+		}
+	}
+	image_close(&image);
+	exit(0);
+}
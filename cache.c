@@ -0,0 +1,278 @@
+// cache.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cache.h"
+
+// Bytes read per step when hashing a file; a whole number of stripes
+#define HASH_CHUNK (1 << 20)
+
+static char cache_root[PATH_MAX];
+static int caching = 0;
+
+// What we knew about a file when we last hashed it
+typedef struct {
+	uint64_t size, inode;
+	int64_t mtime, ctime;
+	uint64_t hash;
+} stamp_t;
+
+// Content hash | Four independent 64-bit lanes over 32-byte stripes, then
+// a final mix of the lanes, the length and the tail. Not cryptographic;
+// it only has to tell images apart.
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME4 0x85EBCA77C2B2AE63ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+
+typedef struct {
+	uint64_t lane[4];
+	uint64_t length;
+} hash_t;
+
+static inline uint64_t rotl(uint64_t x, int r) {
+	return x << r | x >> (64 - r);
+}
+
+static inline uint64_t load64(const unsigned char * p) {
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline uint64_t mix(uint64_t acc, uint64_t in) {
+	acc += in * PRIME2;
+	return rotl(acc, 31) * PRIME1;
+}
+
+static void hash_start(hash_t * h) {
+	h->lane[0] = PRIME1 + PRIME2;
+	h->lane[1] = PRIME2;
+	h->lane[2] = 0;
+	h->lane[3] = -PRIME1;
+	h->length = 0;
+}
+
+// Absorb `n` bytes, a multiple of 32
+static void hash_stripes(hash_t * h, const unsigned char * p, size_t n) {
+	size_t i;
+	for (i = 0; i < n; i += 32) {
+		h->lane[0] = mix(h->lane[0], load64(p + i));
+		h->lane[1] = mix(h->lane[1], load64(p + i + 8));
+		h->lane[2] = mix(h->lane[2], load64(p + i + 16));
+		h->lane[3] = mix(h->lane[3], load64(p + i + 24));
+	}
+	h->length += n;
+}
+
+// Fold in the last `n` < 32 bytes and return the hash
+static uint64_t hash_finish(hash_t * h, const unsigned char * p, size_t n) {
+	uint64_t acc = rotl(h->lane[0], 1) + rotl(h->lane[1], 7) + rotl(h->lane[2], 12) + rotl(h->lane[3], 18);
+	int i;
+	for (i = 0; i < 4; i++) {
+		acc = (acc ^ mix(0, h->lane[i])) * PRIME1 + PRIME4;
+	}
+	acc += h->length + n;
+	for (; n >= 8; p += 8, n -= 8) {
+		acc = rotl(acc ^ mix(0, load64(p)), 27) * PRIME1 + PRIME4;
+	}
+	for (; n > 0; p++, n--) {
+		acc = rotl(acc ^ (*p * PRIME5), 11) * PRIME1;
+	}
+	acc ^= acc >> 33;
+	acc *= PRIME2;
+	acc ^= acc >> 29;
+	acc *= PRIME3;
+	acc ^= acc >> 32;
+	return acc;
+}
+
+static uint64_t hash_bytes(const void * p, size_t n) {
+	hash_t h;
+	size_t whole = n & ~(size_t) 31;
+	hash_start(&h);
+	hash_stripes(&h, (const unsigned char *) p, whole);
+	return hash_finish(&h, (const unsigned char *) p + whole, n - whole);
+}
+
+// Read until `len` bytes or end of file; returns the count, -1 on error
+static ssize_t read_full(int fd, unsigned char * buf, size_t len) {
+	size_t done = 0;
+	while (done < len) {
+		ssize_t n = read(fd, buf + done, len - done);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if (n == 0) {
+			break;
+		}
+		done += n;
+	}
+	return done;
+}
+
+static int hash_fd(int fd, uint64_t * hash) {
+	unsigned char * buf = (unsigned char *) malloc(HASH_CHUNK);
+	hash_t h;
+	ssize_t n;
+	if (buf == NULL) {
+		return -1;
+	}
+	hash_start(&h);
+	while ((n = read_full(fd, buf, HASH_CHUNK)) == HASH_CHUNK) {
+		hash_stripes(&h, buf, n);
+	}
+	if (n >= 0) {
+		size_t whole = n & ~(size_t) 31;
+		hash_stripes(&h, buf, whole);
+		*hash = hash_finish(&h, buf + whole, n - whole);
+	}
+	free(buf);
+	return n < 0 ? -1 : 0;
+}
+
+// Like `mkdir -p`
+static int make_dirs(const char * dir) {
+	char path[PATH_MAX];
+	char * p;
+	if ((size_t) snprintf(path, sizeof(path), "%s", dir) >= sizeof(path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	for (p = path + 1; *p != '\0'; p++) {
+		if (*p == '/') {
+			*p = '\0';
+			if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+				return -1;
+			}
+			*p = '/';
+		}
+	}
+	if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+		return -1;
+	}
+	return access(path, W_OK);
+}
+
+const char * cache_default_dir() {
+	static char dir[PATH_MAX];
+	const char * base = getenv("XDG_CACHE_HOME");
+	if (base != NULL && base[0] != '\0') {
+		snprintf(dir, sizeof(dir), "%s/sonify", base);
+	} else if ((base = getenv("HOME")) != NULL && base[0] != '\0') {
+		snprintf(dir, sizeof(dir), "%s/.cache/sonify", base);
+	} else {
+		return NULL;
+	}
+	return dir;
+}
+
+int cache_init(const char * dir) {
+	caching = 0;
+	if (dir == NULL) {
+		return 0;
+	}
+	// Leave room for entry names
+	if (strlen(dir) + 64 >= sizeof(cache_root)) {
+		fprintf(stderr, "cannot use cache %s: path too long\n", dir);
+		return -1;
+	}
+	if (make_dirs(dir) != 0) {
+		fprintf(stderr, "cannot use cache %s: %s\n", dir, strerror(errno));
+		return -1;
+	}
+	strcpy(cache_root, dir);
+	caching = 1;
+	return 0;
+}
+
+int cache_path(char * out, size_t len, const char * name) {
+	if (!caching) {
+		return -1;
+	}
+	return (size_t) snprintf(out, len, "%s/%s", cache_root, name) < len ? 0 : -1;
+}
+
+int cache_file_hash(const char * path, uint64_t * hash) {
+	char full[PATH_MAX], name[64], stamp_path[PATH_MAX], tmp[PATH_MAX];
+	struct stat st;
+	stamp_t stamp, seen;
+	int fd, rc;
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+		if (fd >= 0) {
+			close(fd);
+		}
+		return -1;
+	}
+	memset(&stamp, 0, sizeof(stamp_t));
+	stamp.size = st.st_size;
+	stamp.inode = st.st_ino;
+	stamp.mtime = st.st_mtime;
+	stamp.ctime = st.st_ctime;
+	// Stamps are named by a hash of the file's full path
+	stamp_path[0] = '\0';
+	if (caching && realpath(path, full) != NULL) {
+		snprintf(name, sizeof(name), "path-%016llx.stamp", (unsigned long long) hash_bytes(full, strlen(full)));
+		cache_path(stamp_path, sizeof(stamp_path), name);
+	}
+	if (stamp_path[0] != '\0') {
+		int sfd = open(stamp_path, O_RDONLY);
+		if (sfd >= 0) {
+			rc = read_full(sfd, (unsigned char *) &seen, sizeof(stamp_t)) == sizeof(stamp_t);
+			close(sfd);
+			if (rc && seen.size == stamp.size && seen.inode == stamp.inode &&
+					seen.mtime == stamp.mtime && seen.ctime == stamp.ctime) {
+				close(fd);
+				*hash = seen.hash;
+				return 0;
+			}
+		}
+	}
+	rc = hash_fd(fd, hash);
+	close(fd);
+	if (rc != 0) {
+		fprintf(stderr, "cannot read %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	// Remember it for next time; if that fails we just hash again
+	if (stamp_path[0] != '\0' && (size_t) snprintf(tmp, sizeof(tmp), "%s.XXXXXX", stamp_path) < sizeof(tmp)) {
+		int sfd = mkstemp(tmp);
+		if (sfd >= 0) {
+			stamp.hash = *hash;
+			rc = write(sfd, &stamp, sizeof(stamp_t)) == sizeof(stamp_t);
+			close(sfd);
+			if (!rc || rename(tmp, stamp_path) != 0) {
+				unlink(tmp);
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,45 @@
+// cache.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// A directory of tone maps and wavetables kept between runs, so starting
+// on an image we have seen before costs page faults rather than a decode.
+// Tone maps are named by a hash of the image's contents; the hash itself
+// is remembered by path, size and mtime, so an unchanged image is not even
+// read. Entries are written under a temporary name and renamed into place,
+// so several instances may share a cache.
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// $XDG_CACHE_HOME/sonify, or ~/.cache/sonify; NULL if neither is set
+const char * cache_default_dir();
+
+// Cache in `dir`, creating it if need be, or not at all if `dir` is NULL.
+// Returns 0 on success, -1 if `dir` cannot be used (and nothing is cached).
+int cache_init(const char * dir);
+
+// Write the path of cache entry `name` to `out`. Returns -1 if there is no
+// cache or the path does not fit.
+int cache_path(char * out, size_t len, const char * name);
+
+// 64-bit hash of the contents of the file at `path`. Returns 0 on success.
+int cache_file_hash(const char * path, uint64_t * hash);
+
+#endif
@@ -24,26 +24,42 @@
  *
  */
 // Thank you, Pascal Getreuer!
+#include <math.h>
 #include <stdint.h>
 #include <SDL.h>
+#include "hsl.h"
 
-// TODO: Uint32_t support? After all, our SDL_Surfaces are 32-bit...
 typedef struct {
 	uint8_t r, g, b;
 } color;
 
-// TODO: Uint32_t support? After all, our SDL_Surfaces are 32-bit...
-color get_color(SDL_Surface * img, int x, int y) {
+// Reads whole pixels of any depth up to 32 bits, stepping rows by `pitch`
+static inline color get_color(SDL_Surface * img, int x, int y) {
 	color rgb;
-	uint8_t r, g, b, pixel;
-	uint8_t * pixels = (uint8_t *) img->pixels;
-	pixel = pixels[(y * img->w) + x];
+	uint8_t * p = (uint8_t *) img->pixels + y * img->pitch + x * img->format->BytesPerPixel;
+	Uint32 pixel;
+	switch (img->format->BytesPerPixel) {
+		case 1: pixel = *p; break;
+		case 2: pixel = *(Uint16 *) p; break;
+		case 3: pixel = SDL_BYTEORDER == SDL_BIG_ENDIAN ? p[0] << 16 | p[1] << 8 | p[2] : p[0] | p[1] << 8 | p[2] << 16; break;
+		default: pixel = *(Uint32 *) p; break;
+	}
 	SDL_GetRGB(pixel, img->format, &rgb.r, &rgb.g, &rgb.b);
 	return rgb;
 }
 
+// Where hsl.h finds the channels of a 32-bit surface, with alpha opaque
+static inline hsl_layout_t surface_layout(SDL_Surface * img) {
+	hsl_layout_t layout;
+	layout.rshift = img->format->Rshift;
+	layout.gshift = img->format->Gshift;
+	layout.bshift = img->format->Bshift;
+	layout.alpha = img->format->Amask;
+	return layout;
+}
+
 // From: http://www.math.ucla.edu/~getreuer/colorspace.html
-void Rgb2Hsl(float * H, float * S, float * L, float R, float G, float B) {
+static inline void Rgb2Hsl(float * H, float * S, float * L, float R, float G, float B) {
 	float Max = max(R, G, B);
 	float Min = min(R, G, B);
 	float C = Max - Min;
@@ -70,7 +86,7 @@ void Rgb2Hsl(float * H, float * S, float * L, float R, float G, float B) {
 }
 
 // From: http://www.math.ucla.edu/~getreuer/colorspace.html
-void Hsl2Rgb(float * R, float * G, float * B, float H, float S, float L) {
+static inline void Hsl2Rgb(float * R, float * G, float * B, float H, float S, float L) {
 	float C = (L <= 0.5) ? (2 * L * S) : ((2 - 2 * L) * S);
 	float Min = L - 0.5 * C;
 	float X;
@@ -115,7 +131,7 @@ void Hsl2Rgb(float * R, float * G, float * B, float H, float S, float L) {
 	}
 }
 
-void Sound2Hsl(float * H, float * S, float * L, float f, float a, long scale, int l) {
+static inline void Sound2Hsl(float * H, float * S, float * L, float f, float a, long scale, int l) {
 	*H = (f - l) / scale;
 	*S = 1;
 	*L = a;
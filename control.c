@@ -0,0 +1,340 @@
+// control.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "control.h"
+#include "ring.h"
+
+static pthread_t controller;
+static int running;
+static ring_t commands;
+static engine_t * engine;
+static unsigned int rate, max_frames;
+// The rate JACK last reported, if patches are not built at it yet
+static unsigned int new_rate;
+// The patch we last swapped in, and one being swapped in, if any
+static patch_t * playing, * pending;
+// The image the GUI loop is drawing
+static const image_t * shown;
+static unsigned int pixel_rate;
+// The FIFO, a writer of our own so it never reads as closed, and a
+// partial line from it
+static int fifo = -1, fifo_writer = -1;
+static char line[CONTROL_COMMAND_SIZE];
+static size_t line_len;
+
+// `value`, or `value` applied to `current` if it starts with an operator
+static double change(double current, const char * value) {
+	double n = atof(value + 1);
+	switch (value[0]) {
+		case '+': return current + n;
+		case '-': return current - n;
+		case '*': return current * n;
+		case '/': return n != 0 ? current / n : 0;
+		default: return atof(value);
+	}
+}
+
+static const char * wave_names[] = { "sin", "sq", "tri", "saw" };
+
+static int same_settings(const settings_t * a, const settings_t * b) {
+	return a->pitch_scale == b->pitch_scale && a->lower_bounds == b->lower_bounds && a->ms_time == b->ms_time &&
+			a->waveform_type == b->waveform_type && a->method == b->method;
+}
+
+static void close_image(image_t * image) {
+	image_close(image);
+	free(image);
+}
+
+// Build the patch for `s` playing `image` at `sample_rate`, swap it in,
+// and free the one it replaces. Takes charge of `image`, closing it if it
+// cannot be played. Returns 0 once the new patch is playing, -1 if it
+// never will be.
+static int swap_to(const settings_t * s, image_t * image, unsigned int sample_rate) {
+	const tone_table_t * table = &playing->table;
+	int new_image = image != playing->image;
+	patch_t * p = (patch_t *) malloc(sizeof(patch_t));
+	if (p == NULL || patch_build(p, s, image, table->channels, table->lanes, sample_rate) != 0) {
+		if (p == NULL) {
+			fprintf(stderr,"memory allocation failed\n");
+		}
+		free(p);
+		if (new_image) {
+			close_image(image);
+		}
+		return -1;
+	}
+	if (hopclock_frames(&p->clock) > max_frames) {
+		fprintf(stderr, "ms time too long to change to without a restart\n");
+		patch_free(p);
+		free(p);
+		if (new_image) {
+			close_image(image);
+		}
+		return -1;
+	}
+	// Grace period | Wait for the engine to fade it in, then for the worker
+	// to hear it, and for a new image, for the GUI loop to draw it. None of
+	// them goes back to an older patch or image after that. If we are
+	// stopped first, control_stop() frees both patches.
+	pending = p;
+	engine_swap(engine, p);
+	while (!engine_swapped(engine) || analysis_patch() != p ||
+			(new_image && __atomic_load_n(&shown, __ATOMIC_ACQUIRE) != image)) {
+		if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+			return -1;
+		}
+		usleep(1000);
+	}
+	if (new_image) {
+		close_image(playing->image);
+	}
+	patch_free(playing);
+	free(playing);
+	playing = p;
+	pending = NULL;
+	__atomic_store_n(&pixel_rate, (unsigned int) (1000 / s->ms_time + 0.5), __ATOMIC_RELAXED);
+	printf("now %d to %d Hz, %g ms a pixel, %s waves, %s detector\n", s->lower_bounds, s->lower_bounds + s->pitch_scale,
+			s->ms_time, wave_names[s->waveform_type], s->method == Fft ? "fft" : "fcomb");
+	return 0;
+}
+
+// Decode the image at `path` in full and play it from the top
+static void play_image(const char * path) {
+	const image_t * current = playing->image;
+	settings_t s = playing->settings;
+	image_t * image = (image_t *) malloc(sizeof(image_t));
+	if (image == NULL) {
+		fprintf(stderr,"memory allocation failed\n");
+		return;
+	}
+	if (image_open(image, path, NULL, 1, current->feedback_mode ? playing->table.channels : 0) != 0) {
+		free(image);
+		return;
+	}
+	printf("%s: %u x %u\n", path, image->map.width, image->map.height);
+	swap_to(&s, image, rate);
+}
+
+static void run_command(const char * command) {
+	settings_t s = playing->settings;
+	char name[16], value[CONTROL_COMMAND_SIZE];
+	int start, end;
+	// The value is the rest of the line, so paths may hold spaces
+	if (sscanf(command, "%15s %n", name, &start) != 1 || command[start] == '\0') {
+		fprintf(stderr, "bad command: %s\n", command);
+		return;
+	}
+	strcpy(value, command + start);
+	for (end = strlen(value); end > 0 && isspace((unsigned char) value[end - 1]); end--) {
+		value[end - 1] = '\0';
+	}
+	if (strcmp(name, "image")==0) {
+		play_image(value);
+		return;
+	} else if (strcmp(name, "scale")==0) {
+		s.pitch_scale = change(s.pitch_scale, value) + 0.5;
+	} else if (strcmp(name, "lower")==0) {
+		s.lower_bounds = change(s.lower_bounds, value) + 0.5;
+	} else if (strcmp(name, "ms")==0) {
+		s.ms_time = change(s.ms_time, value);
+	} else if (strcmp(name, "wave")==0 && strcmp(wave_names[parse_waveform(value)], value)==0) {
+		s.waveform_type = parse_waveform(value);
+	} else if (strcmp(name, "detector")==0 && strcmp(value, "toggle")==0) {
+		s.method = s.method == Fft ? Fcomb : Fft;
+	} else if (strcmp(name, "detector")==0 && parse_method(value) >= 0) {
+		s.method = parse_method(value);
+	} else {
+		fprintf(stderr, "bad command: %s\n", command);
+		return;
+	}
+	if (s.pitch_scale < 1 || s.lower_bounds < 1 || !(s.ms_time > 0)) {
+		fprintf(stderr, "out of range: %s\n", command);
+		return;
+	}
+	// Only the FFT estimator can pull several tones out of one hop
+	if (playing->table.lanes > 1 && s.method != Fft) {
+		fprintf(stderr, "--tones needs the fft detector\n");
+		return;
+	}
+	if (!same_settings(&s, &playing->settings)) {
+		swap_to(&s, playing->image, rate);
+	}
+}
+
+// Rebuild the patch playing for the rate JACK has switched to. Until it
+// fades in, the old one plays on, out of tune, rather than going silent.
+// Returns -1 if it could not, leaving the new rate pending.
+static int change_rate() {
+	settings_t s = playing->settings;
+	unsigned int r = __atomic_load_n(&new_rate, __ATOMIC_ACQUIRE);
+	// Hop slots were sized at the old rate
+	double longest = max_frames * 1000.0 / r;
+	printf("rebuilding for %u Hz\n", r);
+	if (s.ms_time > longest) {
+		s.ms_time = longest;
+		printf("ms time cut to %g to fit\n", s.ms_time);
+	}
+	if (swap_to(&s, playing->image, r) != 0) {
+		return -1;
+	}
+	rate = r;
+	return 0;
+}
+
+// Run every whole line waiting in the FIFO
+static void read_fifo() {
+	char buf[256];
+	ssize_t n, i;
+	while ((n = read(fifo, buf, sizeof(buf))) > 0) {
+		for (i = 0; i < n; i++) {
+			if (buf[i] == '\n') {
+				line[line_len] = '\0';
+				if (line_len > 0) {
+					run_command(line);
+				}
+				line_len = 0;
+			} else if (line_len < sizeof(line) - 1) {
+				line[line_len++] = buf[i];
+			}
+		}
+	}
+}
+
+static void * control_main(void * arg) {
+	char * command;
+	struct pollfd pfd;
+	int rate_wait = 0;
+	while (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+		if (__atomic_load_n(&new_rate, __ATOMIC_ACQUIRE) != rate && --rate_wait <= 0) {
+			rate_wait = change_rate() != 0 ? CONTROL_RATE_RETRY : 0;
+		}
+		while ((command = (char *) ring_read_slot(&commands)) != NULL) {
+			run_command(command);
+			ring_release(&commands);
+		}
+		if (fifo < 0) {
+			usleep(CONTROL_POLL_MS * 1000);
+			continue;
+		}
+		pfd.fd = fifo;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, CONTROL_POLL_MS) > 0) {
+			read_fifo();
+		}
+	}
+	return NULL;
+}
+
+static int open_fifo(const char * path) {
+	struct stat st;
+	if (mkfifo(path, 0600) != 0 && errno != EEXIST) {
+		fprintf(stderr, "cannot create %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (stat(path, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+		fprintf(stderr, "%s is not a FIFO\n", path);
+		return -1;
+	}
+	fifo = open(path, O_RDONLY | O_NONBLOCK);
+	fifo_writer = fifo < 0 ? -1 : open(path, O_WRONLY | O_NONBLOCK);
+	if (fifo < 0 || fifo_writer < 0) {
+		fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+int control_start(engine_t * e, unsigned int sample_rate, unsigned int max_hop_frames, const char * fifo_path) {
+	engine = e;
+	rate = sample_rate;
+	new_rate = sample_rate;
+	max_frames = max_hop_frames;
+	playing = e->patch;
+	pending = NULL;
+	shown = playing->image;
+	pixel_rate = 1000 / playing->settings.ms_time + 0.5;
+	line_len = 0;
+	if (ring_init(&commands, CONTROL_QUEUE, CONTROL_COMMAND_SIZE) != 0) {
+		fprintf(stderr,"memory allocation failed\n");
+		return -1;
+	}
+	if (fifo_path != NULL && open_fifo(fifo_path) != 0) {
+		return -1;
+	}
+	running = 1;
+	if (pthread_create(&controller, NULL, control_main, NULL) != 0) {
+		running = 0;
+		fprintf(stderr, "cannot start control thread\n");
+		return -1;
+	}
+	return 0;
+}
+
+int control_send(const char * command) {
+	char * slot = (char *) ring_write_slot(&commands);
+	if (slot == NULL) {
+		return -1;
+	}
+	strncpy(slot, command, CONTROL_COMMAND_SIZE - 1);
+	slot[CONTROL_COMMAND_SIZE - 1] = '\0';
+	ring_commit(&commands);
+	return 0;
+}
+
+void control_shown(const image_t * image) {
+	__atomic_store_n(&shown, image, __ATOMIC_RELEASE);
+}
+
+void control_set_rate(unsigned int sample_rate) {
+	__atomic_store_n(&new_rate, sample_rate, __ATOMIC_RELEASE);
+}
+
+unsigned int control_pixel_rate() {
+	return __atomic_load_n(&pixel_rate, __ATOMIC_RELAXED);
+}
+
+void control_stop() {
+	__atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+	pthread_join(controller, NULL);
+	if (pending != NULL) {
+		if (pending->image != playing->image) {
+			close_image(pending->image);
+		}
+		patch_free(pending);
+		free(pending);
+	}
+	close_image(playing->image);
+	patch_free(playing);
+	free(playing);
+	if (fifo >= 0) {
+		close(fifo);
+		close(fifo_writer);
+	}
+	ring_free(&commands);
+}
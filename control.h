@@ -0,0 +1,74 @@
+// control.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// Changing settings or images while sonify plays, or following a change
+// of sample rate, without restarting the JACK client. Commands come from
+// the GUI loop through control_send(), or one a line from a FIFO. The
+// control thread builds a new patch (patch.h) for each change, hands it
+// to the engine, which fades it in at the next pixel, and frees the old
+// one once neither the engine nor the analysis worker needs it. An old
+// image also waits for the GUI loop to move on from it; see
+// control_shown().
+//
+// Commands are "scale <hz>", "lower <hz>", "ms <ms>", "wave <sin | sq |
+// tri | saw>", "detector <fcomb | fft | toggle>" and "image <path>",
+// where "toggle" switches to whichever detector is not playing. Any
+// number may instead be "+n" or "-n" to add to the current value, or "*n"
+// or "/n" to scale it. A new image is decoded in full before it plays.
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "engine.h"
+
+// Longest command, including the terminator
+#define CONTROL_COMMAND_SIZE 256
+// Commands waiting from the GUI loop
+#define CONTROL_QUEUE 64
+// How often the control thread looks for commands
+#define CONTROL_POLL_MS 20
+// Polls to wait before trying again to rebuild for a new sample rate
+#define CONTROL_RATE_RETRY 50
+
+// Take charge of the patch `e` is playing and its image, which must both
+// have come from malloc(). New patches play at `sample_rate`, with hops of
+// at most `max_hop_frames` (see analysis_start()). With a `fifo_path`,
+// also read commands from the FIFO there, creating it if need be. Returns
+// 0 on success, -1 after printing why not.
+int control_start(engine_t * e, unsigned int sample_rate, unsigned int max_hop_frames, const char * fifo_path);
+
+// Queue `command` from the GUI loop. Returns -1 if the queue is full.
+int control_send(const char * command);
+
+// JACK has switched to `sample_rate`. The control thread rebuilds the
+// patch playing for it, cutting its ms time if hops that long at the new
+// rate would not fit. Safe to call from any thread.
+void control_set_rate(unsigned int sample_rate);
+
+// GUI loop | Pixels of `image` are all we will draw from now on (see
+// pixel_t), so the images before it can be closed
+void control_shown(const image_t * image);
+
+// Pixels per second of the patch most recently swapped in, from any thread
+unsigned int control_pixel_rate();
+
+// Stop the control thread and free every patch and image, including the
+// ones the engine was playing. Call once the engine and the analysis
+// worker have stopped.
+void control_stop();
+
+#endif
@@ -0,0 +1,254 @@
+// decode.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// sonify-decode: turn an audio file back into an image without JACK. Hops
+// are independent, so they are analyzed in parallel, one pitch detector
+// per worker thread.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sndfile.h>
+#include <gd.h>
+// 
+#include "sonify.h"
+#include "detector.h"
+#include "render.h"
+#include "bands.h"
+#include "hsl.h"
+#include "hopclock.h"
+
+// Hops each worker analyzes per batch read from the file
+#define BATCH_HOPS 1024
+// Hops handed to the detector at once
+#define DETECT_HOPS 64
+
+typedef struct {
+	detector_t detector;
+	pthread_t thread;
+	const sample_t * samples;	// this worker's hops, back to back
+	unsigned int first, count;	// index of the first hop, and how many
+} worker_t;
+
+int pitch_scale, lower_bounds;
+unsigned int hop_frames, tone_lanes = 1;
+int * pixels;				// gd truecolor, `tone_lanes` per hop
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// gd truecolor: 0x00RRGGBB, where an alpha of 0 is opaque
+static const hsl_layout_t gd_layout = { 16, 8, 0, 0 };
+
+// Multi-tone | One pixel per sub-band of each hop; see bands.h
+static void * decode_bands(void * arg) {
+	worker_t * w = (worker_t *) arg;
+	float freqs[MAX_LANES], amps[MAX_LANES], hue[MAX_LANES], light[MAX_LANES];
+	unsigned int i, l;
+	for (i = 0; i < w->count; i++) {
+		detector_bands(&w->detector, w->samples + (size_t) i * hop_frames, tone_lanes, freqs, amps);
+		for (l = 0; l < tone_lanes; l++) {
+			float f = band_unspread(freqs[l], l, tone_lanes, pitch_scale, lower_bounds);
+			decode_hsl(f, amps[l] * tone_lanes, pitch_scale, lower_bounds, &hue[l], &light[l]);
+		}
+		hsl_to_rgb_row(hue, light, tone_lanes, &gd_layout, (uint32_t *) pixels + (size_t) (w->first + i) * tone_lanes);
+	}
+	return NULL;
+}
+
+static void * decode_hops(void * arg) {
+	worker_t * w = (worker_t *) arg;
+	float freqs[DETECT_HOPS], hue[DETECT_HOPS], light[DETECT_HOPS];
+	unsigned int i, j, n;
+	for (i = 0; i < w->count; i += n) {
+		n = w->count - i < DETECT_HOPS ? w->count - i : DETECT_HOPS;
+		detector_pitch_batch(&w->detector, w->samples + (size_t) i * hop_frames, n, freqs);
+		for (j = 0; j < n; j++) {
+			const sample_t * hop = w->samples + (size_t) (i + j) * hop_frames;
+			decode_hsl(freqs[j], render_peak(hop, hop_frames, 0), pitch_scale, lower_bounds, &hue[j], &light[j]);
+		}
+		hsl_to_rgb_row(hue, light, n, &gd_layout, (uint32_t *) pixels + w->first + i);
+	}
+	return NULL;
+}
+
+int main(int argc, char * argv[]) {
+	if (argc < 7) {
+		fprintf(stderr, "usage: sonify-decode <audio file> <output png> <image width> <freq scale> <lowest freq> <ms time> [--threads <n>] [--detector <fcomb | fft>] [--tones <n>]\ni.e. sonify-decode img.wav img.png 320 10000 1000 1\n");
+		exit(1);
+	}
+	int width = atoi(argv[3]);
+	pitch_scale = atoi(argv[4]);
+	lower_bounds = atoi(argv[5]);
+	double ms_time = atof(argv[6]);
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	enum METHOD method = Fcomb;
+	int i;
+	for (i = 7; i < argc; i++) {
+		if (strcmp(argv[i], "--threads")==0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--detector")==0 && i + 1 < argc && parse_method(argv[i + 1]) >= 0) {
+			method = parse_method(argv[++i]);
+		} else if (strcmp(argv[i], "--tones")==0 && i + 1 < argc) {
+			tone_lanes = atoi(argv[++i]);
+			if (tone_lanes < 1 || tone_lanes > MAX_LANES) {
+				fprintf(stderr, "--tones must be between 1 and %d\n", MAX_LANES);
+				exit(1);
+			}
+		} else {
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			exit(1);
+		}
+	}
+	if (width < 1) {
+		fprintf(stderr, "image width must be at least 1\n");
+		exit(1);
+	}
+	if (threads < 1) {
+		threads = 1;
+	}
+	// Only the FFT estimator can pull several tones out of one hop
+	if (tone_lanes > 1) {
+		method = Fft;
+	}
+
+	// Open input
+	SF_INFO info;
+	memset(&info, 0, sizeof(SF_INFO));
+	SNDFILE * in = sf_open(argv[1], SFM_READ, &info);
+	if (in == NULL) {
+		fprintf(stderr, "cannot open %s: %s\n", argv[1], sf_strerror(NULL));
+		exit(1);
+	}
+	// Pixels start where the encoder started them, and only the first
+	// `hop_frames` of each is analyzed, as in process()
+	hopclock_t clock;
+	if (hopclock_init(&clock, info.samplerate, ms_time) != 0) {
+		fprintf(stderr, "ms time must be more than 0\n");
+		exit(1);
+	}
+	hop_frames = hopclock_frames(&clock);
+	// Like process(), a trailing partial pixel is never analyzed
+	unsigned int hops = hopclock_pixels(&clock, info.frames);
+	if (hops == 0) {
+		fprintf(stderr, "%s is shorter than one pixel\n", argv[1]);
+		exit(1);
+	}
+	printf("render kernels: %s\n", render_init());
+
+	// One detector per worker, created here since aubio's setup is not thread-safe
+	worker_t * workers = (worker_t *) calloc(threads, sizeof(worker_t));
+	size_t batch_frames = (size_t) threads * BATCH_HOPS * hop_frames;
+	sample_t * batch = (sample_t *) malloc(batch_frames * sizeof(sample_t));
+	// Pixels may be a frame longer than the hop we analyze
+	float * interleaved = (float *) malloc((batch_frames + (size_t) threads * BATCH_HOPS) * info.channels * sizeof(float));
+	pixels = (int *) calloc((size_t) hops * tone_lanes, sizeof(int));
+	if (workers == NULL || batch == NULL || interleaved == NULL || pixels == NULL) {
+		fprintf(stderr,"memory allocation failed\n");
+		exit(3);
+	}
+	int t;
+	for (t = 0; t < threads; t++) {
+		if (detector_init(&workers[t].detector, method, info.samplerate, hop_frames, lower_bounds, pitch_scale) != 0) {
+			fprintf(stderr, "cannot create pitch detector\n");
+			exit(1);
+		}
+	}
+
+	// Read a batch of hops, split it between the workers, repeat
+	double start = now();
+	unsigned int done = 0;
+	while (done < hops) {
+		unsigned int n = hops - done, share, j;
+		size_t s;
+		if (n > (unsigned int) threads * BATCH_HOPS) {
+			n = threads * BATCH_HOPS;
+		}
+		uint64_t base = hopclock_offset(&clock, done);
+		sf_count_t got = sf_readf_float(in, interleaved, hopclock_offset(&clock, done + n) - base);
+		while (n > 0 && hopclock_offset(&clock, done + n) - base > (uint64_t) got) {
+			n--;
+		}
+		if (n == 0) {
+			break;
+		}
+		// Decode the first channel only, and the first `hop_frames` of each pixel
+		for (j = 0; j < n; j++) {
+			const float * pixel = interleaved + (hopclock_offset(&clock, done + j) - base) * info.channels;
+			for (s = 0; s < hop_frames; s++) {
+				batch[(size_t) j * hop_frames + s] = pixel[s * info.channels];
+			}
+		}
+		share = (n + threads - 1) / threads;
+		for (t = 0; t < threads; t++) {
+			unsigned int first = t * share;
+			workers[t].count = first < n ? (n - first < share ? n - first : share) : 0;
+			workers[t].first = done + first;
+			workers[t].samples = batch + (size_t) first * hop_frames;
+			if (workers[t].count > 0) {
+				pthread_create(&workers[t].thread, NULL, tone_lanes > 1 ? decode_bands : decode_hops, &workers[t]);
+			}
+		}
+		for (t = 0; t < threads; t++) {
+			if (workers[t].count > 0) {
+				pthread_join(workers[t].thread, NULL);
+			}
+		}
+		done += n;
+	}
+	double elapsed = now() - start;
+	sf_close(in);
+
+	// Write PNG
+	unsigned int count = done * tone_lanes;
+	int height = (count + width - 1) / width;
+	gdImagePtr image = gdImageCreateTrueColor(width, height);
+	if (image == NULL) {
+		fprintf(stderr,"memory allocation failed\n");
+		exit(3);
+	}
+	unsigned int p;
+	for (p = 0; p < count; p++) {
+		gdImageSetPixel(image, p % width, p / width, pixels[p]);
+	}
+	FILE * out = fopen(argv[2], "wb");
+	if (out == NULL) {
+		fprintf(stderr, "cannot open %s\n", argv[2]);
+		exit(1);
+	}
+	gdImagePng(image, out);
+	fclose(out);
+	gdImageDestroy(image);
+
+	printf("%u pixels (%dx%d) from %llu samples in %.3f s on %d threads: %.0f pixels/sec, %.0f samples/sec (%.1fx realtime)\n",
+			count, width, height, (unsigned long long) hopclock_offset(&clock, done), elapsed, threads,
+			count / elapsed, hopclock_offset(&clock, done) / elapsed, hopclock_offset(&clock, done) / elapsed / info.samplerate);
+	for (t = 0; t < threads; t++) {
+		detector_free(&workers[t].detector);
+	}
+	free(workers);
+	free(batch);
+	free(interleaved);
+	free(pixels);
+	exit(0);
+}
@@ -0,0 +1,89 @@
+// detector.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <string.h>
+#include "detector.h"
+#include "math_util.h"
+#include "color_util.h"
+
+// Aubio | Init pitch detection & aubio_fvec. The buffer is one hop long;
+// aubio wants a sample count here, not a byte count.
+// Fft | Init plans for the range we expect to hear
+int detector_init(detector_t * d, enum METHOD method, unsigned int sample_rate, unsigned int hop_frames,
+		int lower_bounds, int pitch_scale) {
+	memset(d, 0, sizeof(detector_t));
+	d->method = method;
+	d->frames = hop_frames;
+	if (method == Fft) {
+		return fftpitch_init(&d->fft, sample_rate, hop_frames, lower_bounds, lower_bounds + pitch_scale);
+	}
+	d->aubio = new_aubio_pitchdetection(hop_frames, hop_frames, 1, sample_rate, aubio_pitch_fcomb, aubio_pitchm_freq);
+	d->fvec = new_fvec(hop_frames, 1);
+	return d->aubio != NULL && d->fvec != NULL ? 0 : -1;
+}
+
+void detector_free(detector_t * d) {
+	if (d->method == Fft) {
+		fftpitch_free(&d->fft);
+	}
+	if (d->aubio != NULL) {
+		del_aubio_pitchdetection(d->aubio);
+	}
+	if (d->fvec != NULL) {
+		del_fvec(d->fvec);
+	}
+	d->aubio = NULL;
+	d->fvec = NULL;
+}
+
+float detector_pitch(detector_t * d, const sample_t * hop) {
+	float f;
+	if (d->method == Fft) {
+		fftpitch_estimate(&d->fft, hop, 1, &f);
+		return f;
+	}
+	memcpy(d->fvec->data[0], hop, d->frames * sizeof(sample_t));
+	return aubio_pitchdetection(d->aubio, d->fvec);
+}
+
+void detector_pitch_batch(detector_t * d, const sample_t * hops, unsigned int count, float * freqs) {
+	unsigned int i;
+	if (d->method == Fft) {
+		fftpitch_estimate(&d->fft, hops, count, freqs);
+		return;
+	}
+	for (i = 0; i < count; i++) {
+		freqs[i] = detector_pitch(d, hops + (size_t) i * d->frames);
+	}
+}
+
+void detector_bands(detector_t * d, const sample_t * hop, unsigned int lanes, float * freqs, float * amps) {
+	fftpitch_bands(&d->fft, hop, lanes, freqs, amps);
+}
+
+int parse_method(const char * name) {
+	if (strcmp(name, "fcomb")==0) { return Fcomb; }
+	else if (strcmp(name, "fft")==0) { return Fft; }
+	return -1;
+}
+
+void decode_hsl(float f, float peak, int pitch_scale, int lower_bounds, float * H, float * L) {
+	float S;
+	Sound2Hsl(H, &S, L, f, peak, pitch_scale, lower_bounds);
+	*L = 1 - *L;
+}
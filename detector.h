@@ -0,0 +1,62 @@
+// detector.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// Pitch detection for one hop of audio, and turning a detected pitch and
+// peak back into a pixel.
+#ifndef DETECTOR_H
+#define DETECTOR_H
+
+#include <aubio/aubio.h>
+#include "sonify.h"
+#include "fftpitch.h"
+
+// Aubio's fcomb detector, or our own FFT peak estimator (fftpitch.h)
+enum METHOD { Fcomb = 0, Fft };
+
+typedef struct {
+	enum METHOD method;
+	aubio_pitchdetection_t * aubio;
+	fvec_t * fvec;
+	fftpitch_t fft;
+	unsigned int frames;		// samples per hop
+} detector_t;
+
+// Not thread-safe: aubio and FFTW plan their FFTs here, so create
+// detectors from one thread. Each detector may then be used from its own
+// thread. `lower_bounds` and `pitch_scale` give the range to search.
+int detector_init(detector_t * d, enum METHOD method, unsigned int sample_rate, unsigned int hop_frames,
+		int lower_bounds, int pitch_scale);
+void detector_free(detector_t * d);
+
+// Frequency of `d->frames` samples of `hop`, in Hz
+float detector_pitch(detector_t * d, const sample_t * hop);
+// Frequencies of `count` hops stored back to back
+void detector_pitch_batch(detector_t * d, const sample_t * hops, unsigned int count, float * freqs);
+
+// Multi-tone | Frequency and amplitude in each of `lanes` sub-bands.
+// Needs the Fft method.
+void detector_bands(detector_t * d, const sample_t * hop, unsigned int lanes, float * freqs, float * amps);
+
+// "fcomb" or "fft"; returns -1 for anything else
+int parse_method(const char * name);
+
+// Hue and lightness of the pixel for frequency `f` at amplitude `peak`,
+// via Sound2Hsl(); hsl_to_rgb_row() turns a row of them into pixels
+void decode_hsl(float f, float peak, int pitch_scale, int lower_bounds, float * H, float * L);
+
+#endif
@@ -0,0 +1,167 @@
+// encode.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// sonify-encode: render an image to an audio file without JACK, as fast as
+// the CPU allows. Uses the same tones and oscillator as the JACK client.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/time.h>
+#include <sndfile.h>
+// 
+#include "sonify.h"
+#include "tones.h"
+#include "wavebank.h"
+#include "render.h"
+#include "bands.h"
+#include "cache.h"
+#include "hopclock.h"
+
+// Frames rendered between writes; bounds memory use whatever the image size
+#define CHUNK_FRAMES 65536
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// FLAC if the file name says so, otherwise float WAV
+static int output_format(const char * path) {
+	const char * ext = strrchr(path, '.');
+	if (ext != NULL && strcasecmp(ext, ".flac") == 0) {
+		return SF_FORMAT_FLAC | SF_FORMAT_PCM_24;
+	}
+	return SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+}
+
+int main(int argc, char * argv[]) {
+	if (argc < 7) {
+		fprintf(stderr, "usage: sonify-encode <image path> <output file> <freq scale> <lowest freq> <ms time> <sin | sq | tri | saw> [sample rate] [--tones <n>] [--tonemap <file>] [--cache <dir> | --no-cache]\ni.e. sonify-encode img.png img.wav 10000 1000 1 sin 44100\n");
+		exit(1);
+	}
+	int pitch_scale = atoi(argv[3]);
+	int lower_bounds = atoi(argv[4]);
+	double ms_time = atof(argv[5]);
+	enum TYPE waveform_type = parse_waveform(argv[6]);
+	unsigned int sample_rate = 44100;
+	int tone_lanes = 1;
+	const char * tonemap_path = NULL;
+	const char * cache_dir = cache_default_dir();
+	int i, l;
+	for (i = 7; i < argc; i++) {
+		if (strcmp(argv[i], "--tones")==0 && i + 1 < argc) {
+			tone_lanes = atoi(argv[++i]);
+			if (tone_lanes < 1 || tone_lanes > MAX_LANES) {
+				fprintf(stderr, "--tones must be between 1 and %d\n", MAX_LANES);
+				exit(1);
+			}
+		} else if (strcmp(argv[i], "--tonemap")==0 && i + 1 < argc) {
+			tonemap_path = argv[++i];
+		} else if (strcmp(argv[i], "--cache")==0 && i + 1 < argc) {
+			cache_dir = argv[++i];
+		} else if (strcmp(argv[i], "--no-cache")==0) {
+			cache_dir = NULL;
+		} else if (i == 7 && argv[i][0] != '-') {
+			sample_rate = atoi(argv[i]);
+		} else {
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			exit(1);
+		}
+	}
+	hopclock_t clock;
+	if (hopclock_init(&clock, sample_rate, ms_time) != 0) {
+		fprintf(stderr, "ms time must be more than 0\n");
+		exit(1);
+	}
+
+	// Map image & Generate Tones From Pixels
+	tonemap_t tone_map;
+	tone_table_t tone_table;
+	cache_init(cache_dir);
+	if (tonemap_open(&tone_map, argv[1], tonemap_path) != 0) {
+		exit(1);
+	}
+	int image_tones_size = tone_table_init(&tone_table, &tone_map, 1, tone_lanes, pitch_scale, lower_bounds);
+	wavebank_t bank;
+	if (wavebank_build(&bank, sample_rate, waveform_type) != 0) {
+		fprintf(stderr,"memory allocation failed\n");
+		exit(3);
+	}
+	printf("render kernels: %s\n", render_init());
+
+	// Open output
+	SF_INFO info;
+	memset(&info, 0, sizeof(SF_INFO));
+	info.samplerate = sample_rate;
+	info.channels = 1;
+	info.format = output_format(argv[2]);
+	SNDFILE * out = sf_open(argv[2], SFM_WRITE, &info);
+	if (out == NULL) {
+		fprintf(stderr, "cannot open %s: %s\n", argv[2], sf_strerror(NULL));
+		exit(1);
+	}
+	sample_t * chunk = (sample_t *) malloc(CHUNK_FRAMES * sizeof(sample_t));
+	if (chunk == NULL) {
+		fprintf(stderr,"memory allocation failed\n");
+		exit(3);
+	}
+
+	// Render every group of `tone_lanes` pixels for as long as the clock
+	// says, writing out whole chunks
+	double start = now();
+	unsigned long long total = 0;
+	unsigned int fill = 0, left, span;
+	osc_t osc[MAX_LANES];
+	for (l = 0; l < tone_lanes; l++) {
+		osc[l].phase = 0;
+	}
+	for (i = 0; i < image_tones_size; i += tone_lanes) {
+		for (l = 0; l < tone_lanes; l++) {
+			float f, gain;
+			tone_table_entry(&tone_table, i + l, &f, &gain);
+			osc[l].tone = wavebank_tone(&bank, f, gain);
+		}
+		for (left = hopclock_next(&clock); left > 0; left -= span) {
+			span = CHUNK_FRAMES - fill;
+			if (span > left) {
+				span = left;
+			}
+			render_tones(osc, tone_lanes, chunk + fill, span);
+			fill += span;
+			if (fill == CHUNK_FRAMES) {
+				sf_writef_float(out, chunk, fill);
+				total += fill;
+				fill = 0;
+			}
+		}
+	}
+	sf_writef_float(out, chunk, fill);
+	total += fill;
+	sf_close(out);
+	double elapsed = now() - start;
+
+	printf("%d pixels, %llu samples in %.3f s: %.0f pixels/sec, %.0f samples/sec (%.1fx realtime)\n",
+			image_tones_size, total, elapsed, image_tones_size / elapsed, total / elapsed,
+			total / elapsed / sample_rate);
+	free(chunk);
+	wavebank_free(&bank);
+	tonemap_close(&tone_map);
+	exit(0);
+}
@@ -0,0 +1,183 @@
+// engine.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <string.h>
+#include "engine.h"
+#include "render.h"
+#include "stats.h"
+
+// Switch our oscillators to step `i` of the tone table, one per lane of
+// each channel. The phase is left alone so each waveform continues
+// smoothly into its new tone. A pixel the producer has not built yet
+// keeps playing the tone before it, unless the producer has not reached
+// its stripe at all: stripes below the first stay silent until it does
+// (tonemap.h).
+static void select_tone(engine_t * e, int i) {
+	const tone_table_t * table = &e->patch->table;
+	int j, step = table->channels * table->lanes, held = 0;
+	unsigned int ready = tonemap_ready(table->map), pixel;
+	float f, gain;
+	for (j = 0; j < step; j++) {
+		pixel = tone_table_pixel(table, i + j);
+		if (pixel >= ready) {
+			if (pixel >= (unsigned int) table->stripe && pixel - pixel % table->stripe >= ready) {
+				e->osc[j].tone.gain = 0;
+			} else {
+				held = 1;
+			}
+			continue;
+		}
+		tone_table_entry(table, i + j, &f, &gain);
+		e->osc[j].tone = wavebank_tone(&e->patch->bank, f, gain);
+		// Each stripe is read in order, so this touches the next cache line
+		// of each well before we need it
+		tone_table_prefetch(table, i + j + TONE_PREFETCH_STEPS * step);
+	}
+	// Hops that held a tone because the tone map had not got that far yet
+	if (held) {
+		stats_add(StatToneUnderruns, 1);
+	}
+}
+
+// Take over from the patch playing. Its oscillators keep going, at their
+// old tones, while they fade out; see crossfade(). Returns 1 if the patch
+// plays another image, which starts from the top.
+static int take_patch(engine_t * e, patch_t * patch) {
+	int restart = patch->image != e->patch->image;
+	memcpy(e->fade_osc, e->osc, sizeof(e->osc));
+	e->fade_left = ENGINE_FADE_FRAMES;
+	e->patch = patch;
+	e->clock = patch->clock;
+	e->hop_frames = hopclock_frames(&patch->clock);
+	if (restart) {
+		e->hop_index = 0;
+	}
+	return restart;
+}
+
+// Mix the old patch's `lanes` oscillators starting at `osc` under the `n`
+// frames of the new one in `out`, fading linearly from one to the other
+static void crossfade(engine_t * e, osc_t * osc, int lanes, sample_t * out, unsigned int n) {
+	unsigned int j, done = ENGINE_FADE_FRAMES - e->fade_left;
+	render_tones(osc, lanes, e->fade_buf, n);
+	for (j = 0; j < n; j++) {
+		float g = (done + j) * (1.0f / ENGINE_FADE_FRAMES);
+		out[j] = e->fade_buf[j] + g * (out[j] - e->fade_buf[j]);
+	}
+}
+
+void engine_init(engine_t * e, patch_t * patch) {
+	int j;
+	memset(e, 0, sizeof(engine_t));
+	e->patch = patch;
+	e->clock = patch->clock;
+	e->hop_frames = hopclock_frames(&patch->clock);
+	e->step_frames = hopclock_next(&e->clock);
+	// Start silent, in case the first pixels are not built yet
+	for (j = 0; j < patch->table.channels * patch->table.lanes; j++) {
+		e->osc[j].tone = wavebank_tone(&patch->bank, 0, 0);
+	}
+	select_tone(e, 0);
+}
+
+void engine_process(engine_t * e, sample_t * const * in, sample_t * const * out, unsigned int nframes) {
+	const tone_table_t * table = &e->patch->table;
+	int channels = table->channels, lanes = table->lanes;
+	uint64_t start = stats_now(), t;
+	unsigned int i = 0, span, captured;
+	patch_t * next;
+	int c;
+	// Render in spans that end at pixel boundaries, so the kernels in
+	// render.c see a single tone and a single hop at a time
+	while (i < nframes) {
+		if (e->framecount >= e->step_frames) {
+			int index = e->index + channels * lanes;
+			if (index >= table->count) {
+				index = 0;
+			}
+			// A new patch starts on a pixel boundary, once the last has
+			// finished fading in
+			next = __atomic_load_n(&e->next, __ATOMIC_ACQUIRE);
+			if (next != NULL && next != e->patch && e->fade_left == 0) {
+				if (take_patch(e, next)) {
+					index = 0;
+				}
+				table = &e->patch->table;
+			}
+			__atomic_store_n(&e->index, index, __ATOMIC_RELAXED);
+			// Switch to the waveform for the next pixel of our original image,
+			// or in feedback mode what we last heard there
+			t = stats_now();
+			select_tone(e, index);
+			stats_record(StatToneSwitch, stats_now() - t);
+			// Hand the analyzed samples to the analysis worker
+			if (e->hop != NULL) {
+				memcpy(e->hop->peak, e->max_amp, channels * sizeof(sample_t));
+				ring_commit(&hop_ring);
+				stats_record(StatHopFill, ring_fill(&hop_ring));
+				analysis_wake();
+			}
+			e->framecount = 0;
+			e->step_frames = hopclock_next(&e->clock);
+			memset(e->max_amp, 0, sizeof(e->max_amp));
+		}
+		if (e->framecount == 0) {
+			// If the worker has fallen behind, this pixel is left as it was
+			e->hop = (hop_t *) ring_write_slot(&hop_ring);
+			if (e->hop != NULL) {
+				e->hop->index = e->hop_index;
+				e->hop->patch = e->patch;
+			} else {
+				stats_add(StatDroppedHops, 1);
+			}
+			e->hop_index++;
+		}
+		span = e->step_frames - e->framecount;
+		if (span > nframes - i) {
+			span = nframes - i;
+		}
+		if (e->fade_left > 0 && span > e->fade_left) {
+			span = e->fade_left;
+		}
+		// A step may be a frame longer than the hop we analyze
+		captured = e->framecount < e->hop_frames ? e->hop_frames - e->framecount : 0;
+		if (captured > span) {
+			captured = span;
+		}
+		for (c = 0; c < channels; c++) {
+			render_tones(e->osc + c * lanes, lanes, out[c] + i, span);
+			if (e->fade_left > 0) {
+				crossfade(e, e->fade_osc + c * lanes, lanes, out[c] + i, span);
+			}
+			if (e->hop != NULL) {
+				memcpy(e->hop->data + c * e->hop_frames + e->framecount, in[c] + i, captured * sizeof(sample_t));
+			}
+			e->max_amp[c] = render_peak(in[c] + i, captured, e->max_amp[c]);
+		}
+		if (e->fade_left > 0) {
+			e->fade_left -= span;
+			// The old patch is silent now; let engine_swap() have another
+			if (e->fade_left == 0) {
+				__atomic_store_n(&e->next, NULL, __ATOMIC_RELEASE);
+			}
+		}
+		e->framecount += span;
+		i += span;
+	}
+	stats_record(StatCallback, stats_now() - start);
+}
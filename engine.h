@@ -0,0 +1,91 @@
+// engine.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// Everything process() does, apart from JACK: play the tone table one hop
+// at a time on every channel, and capture each hop of input for the
+// analysis worker. A backend owns the buffers and the clock; sonify's is
+// JACK, sonify-bench's is a loop. Apart from engine_init(), nothing here
+// allocates, locks or calls into libm. What to play comes from a patch
+// (patch.h), which another thread may replace while we play.
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "sonify.h"
+#include "patch.h"
+#include "analysis.h"
+#include "bands.h"
+
+// Steps of the tone table to prefetch ahead of the one playing
+#define TONE_PREFETCH_STEPS 8
+// Frames over which a new patch fades in as the old one fades out
+#define ENGINE_FADE_FRAMES 256
+
+typedef struct {
+	patch_t * patch;		// playing
+	patch_t * next;			// from engine_swap(), until it has faded in
+	unsigned int hop_frames;	// frames captured from the start of each step
+	// Playback | Owned by engine_process()
+	hopclock_t clock;
+	int index;			// first entry of the step playing; see engine_index()
+	unsigned int step_frames;	// frames in this step; see hopclock.h
+	unsigned int framecount;	// frames played of this step
+	unsigned int hop_index;
+	hop_t * hop;			// being captured, or NULL if the ring was full
+	sample_t max_amp[MAX_CHANNELS];
+	// `lanes` oscillators per channel, in the same order as each step of
+	// the tone table
+	osc_t osc[MAX_CHANNELS * MAX_LANES];
+	// Crossfade | The old patch's oscillators, while they fade out
+	unsigned int fade_left;
+	osc_t fade_osc[MAX_CHANNELS * MAX_LANES];
+	sample_t fade_buf[ENGINE_FADE_FRAMES];
+} engine_t;
+
+// Start at the top of `patch`'s tone table, one step per pixel of its
+// clock, capturing the first hopclock_frames() of each. The analysis
+// worker (analysis.h) must already be running with room for hops that
+// size.
+void engine_init(engine_t * e, patch_t * patch);
+
+// Play `patch` from the next pixel on, fading over from the one playing.
+// It must have the same channels and lanes. If it plays another image,
+// that image starts from its first pixel, and so does the hop count the
+// analysis worker places pixels by. Call from one thread at a time, and
+// only once engine_swapped().
+static inline void engine_swap(engine_t * e, patch_t * patch) {
+	__atomic_store_n(&e->next, patch, __ATOMIC_RELEASE);
+}
+
+// Whether the last engine_swap() is complete, so the patch it replaced
+// is no longer played. The analysis worker may still be hearing it; see
+// analysis_patch().
+static inline int engine_swapped(const engine_t * e) {
+	return __atomic_load_n(&e->next, __ATOMIC_ACQUIRE) == NULL;
+}
+
+// Render `nframes` frames of every channel into `out`, capturing `in`.
+// `in[c]` may be `out[c]`: each span is rendered before it is captured,
+// so that is a loopback with no latency.
+void engine_process(engine_t * e, sample_t * const * in, sample_t * const * out, unsigned int nframes);
+
+// The entry playing, from any thread
+static inline int engine_index(const engine_t * e) {
+	return __atomic_load_n(&e->index, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -0,0 +1,98 @@
+// feedback.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "feedback.h"
+
+int feedback_init(feedback_t * fb, const tonemap_t * map, int channels) {
+	int c, k;
+	memset(fb, 0, sizeof(feedback_t));
+	fb->width = map->width;
+	fb->height = map->height;
+	fb->count = map->count;
+	fb->channels = channels;
+	fb->front = (unsigned char *) calloc(map->height, 1);
+	fb->open_row = (int *) malloc(channels * sizeof(int));
+	for (k = 0; k < 2; k++) {
+		fb->hue[k] = (uint16_t *) malloc(map->count * sizeof(uint16_t));
+		fb->amp[k] = (uint8_t *) malloc(map->count);
+		if (fb->hue[k] == NULL || fb->amp[k] == NULL) {
+			break;
+		}
+		memcpy(fb->hue[k], map->hue, map->count * sizeof(uint16_t));
+		memcpy(fb->amp[k], map->amp, map->count);
+	}
+	if (fb->front == NULL || fb->open_row == NULL || k < 2) {
+		feedback_free(fb);
+		return -1;
+	}
+	for (c = 0; c < channels; c++) {
+		fb->open_row[c] = -1;
+	}
+	return 0;
+}
+
+void feedback_free(feedback_t * fb) {
+	int k;
+	for (k = 0; k < 2; k++) {
+		free(fb->hue[k]);
+		free(fb->amp[k]);
+		fb->hue[k] = NULL;
+		fb->amp[k] = NULL;
+	}
+	free(fb->front);
+	free(fb->open_row);
+	fb->front = NULL;
+	fb->open_row = NULL;
+}
+
+// Swap in the row `channel` was rebuilding, if any. The fence keeps our
+// next writes to the copy it retires from being seen before the flip, so
+// feedback_tone() can tell when they might have torn its read.
+static void close_row(feedback_t * fb, int channel) {
+	int row = fb->open_row[channel];
+	if (row >= 0) {
+		__atomic_store_n(&fb->front[row], !fb->front[row], __ATOMIC_RELEASE);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		fb->open_row[channel] = -1;
+	}
+}
+
+void feedback_write(feedback_t * fb, int channel, unsigned int i, float hue, float light) {
+	int row = i / fb->width, back;
+	size_t first = (size_t) row * fb->width;
+	if (row != fb->open_row[channel]) {
+		close_row(fb, channel);
+		// Pixels dropped while the analysis worker was behind keep what
+		// they played last
+		back = !fb->front[row];
+		memcpy(fb->hue[back] + first, fb->hue[!back] + first, fb->width * sizeof(uint16_t));
+		memcpy(fb->amp[back] + first, fb->amp[!back] + first, fb->width);
+		fb->open_row[channel] = row;
+	}
+	back = !fb->front[row];
+	// Quantized as in tonemap.c; a detector can stray outside the range
+	hue = hue < 0 ? 0 : hue > 1 ? 1 : hue;
+	light = light < 0 ? 0 : light > 1 ? 1 : light;
+	fb->hue[back][i] = (uint16_t) (uint32_t) (hue * 65536 + 0.5f);
+	fb->amp[back][i] = (uint8_t) ((1 - light) * 255 + 0.5f);
+	if (i + 1 == first + fb->width) {
+		close_row(fb, channel);
+	}
+}
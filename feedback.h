@@ -0,0 +1,74 @@
+// feedback.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// Feedback mode: decoded pixels replace the tones they were decoded from,
+// so what sonify plays drifts with what it hears. Every row of the image
+// is kept twice. process() reads the copy named by the row's entry in
+// `front` while the GUI loop rebuilds the other one from decoded pixels;
+// when a row is done the GUI loop flips `front`. Neither side locks,
+// waits or allocates, and process() never sees a half-rebuilt row.
+#ifndef FEEDBACK_H
+#define FEEDBACK_H
+
+#include <stdint.h>
+#include "tonemap.h"
+
+typedef struct {
+	unsigned int width, height, count;
+	uint16_t * hue[2];		// as in tonemap_t, one per copy
+	uint8_t * amp[2];
+	unsigned char * front;		// per row: the copy process() reads
+	// Rebuilding | Owned by the GUI loop
+	int channels;
+	int * open_row;			// per channel: the row being rebuilt, or -1
+} feedback_t;
+
+// Start both copies of every row from `map`, which must be fully built
+// (tonemap_finish()). Pixels arrive from `channels` stripes at once, each
+// a whole number of rows (tone_table_init()), so no row is rebuilt by two
+// channels. Returns 0 on success, -1 if out of memory.
+int feedback_init(feedback_t * fb, const tonemap_t * map, int channels);
+void feedback_free(feedback_t * fb);
+
+// GUI loop | Pixel `i` of the image, decoded from `channel`, is now `hue`
+// and `light`. Its row is swapped in once it is complete, or once
+// `channel` moves on to another row.
+void feedback_write(feedback_t * fb, int channel, unsigned int i, float hue, float light);
+
+// Hue in [0, 1) and amplitude in [0, 1] of pixel `i`. Safe to call from
+// process(). The GUI loop may flip the row and start rebuilding the copy
+// we were reading, so check `front` again afterwards, as with a seqlock,
+// and read the other copy if it moved. A row flips once per row of pixels
+// decoded, so one retry is as many as we will ever see in practice.
+static inline void feedback_tone(const feedback_t * fb, unsigned int i, float * hue, float * amp) {
+	const unsigned char * front = &fb->front[i / fb->width];
+	int copy = __atomic_load_n(front, __ATOMIC_ACQUIRE), read;
+	uint16_t h;
+	uint8_t a;
+	do {
+		read = copy;
+		h = __atomic_load_n(&fb->hue[read][i], __ATOMIC_RELAXED);
+		a = __atomic_load_n(&fb->amp[read][i], __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		copy = __atomic_load_n(front, __ATOMIC_RELAXED);
+	} while (copy != read);
+	*hue = h * (1.0f / 65536);
+	*amp = a * (1.0f / 255);
+}
+
+#endif
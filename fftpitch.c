@@ -0,0 +1,220 @@
+// fftpitch.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fftpitch.h"
+
+static float * hann(unsigned int n) {
+	float * w = (float *) malloc(n * sizeof(float));
+	unsigned int i;
+	if (w == NULL) {
+		return NULL;
+	}
+	for (i = 0; i < n; i++) {
+		w[i] = 0.5 - 0.5 * cos(2 * PI * (i + 0.5) / n);
+	}
+	return w;
+}
+
+int fftpitch_init(fftpitch_t * fp, unsigned int sample_rate, unsigned int frames, float lower, float upper) {
+	unsigned int i;
+	int n;
+	memset(fp, 0, sizeof(fftpitch_t));
+	fp->frames = frames;
+	fp->sample_rate = sample_rate;
+	fp->lower = lower;
+	fp->upper = upper;
+	fp->size = 256;
+	while (fp->size < 8 * frames) {
+		fp->size <<= 1;
+	}
+	// One bin of margin either side, and room for the parabola
+	fp->lo_bin = lower * fp->size / sample_rate;
+	fp->hi_bin = upper * fp->size / sample_rate + 2;
+	if (fp->lo_bin < 1) {
+		fp->lo_bin = 1;
+	}
+	if (fp->hi_bin > fp->size / 2 - 1) {
+		fp->hi_bin = fp->size / 2 - 1;
+	}
+	if (fp->lo_bin > fp->hi_bin) {
+		fp->lo_bin = fp->hi_bin;
+	}
+	fp->sub_hop = frames / 4;
+	fp->sub_frames = frames - fp->sub_hop;
+	fp->window = hann(frames);
+	fp->sub_window = hann(fp->sub_frames > 0 ? fp->sub_frames : 1);
+	fp->in = (float *) fftwf_malloc(FFTPITCH_BATCH * fp->size * sizeof(float));
+	fp->out = (fftwf_complex *) fftwf_malloc(FFTPITCH_BATCH * (fp->size / 2 + 1) * sizeof(fftwf_complex));
+	if (fp->window == NULL || fp->sub_window == NULL || fp->in == NULL || fp->out == NULL) {
+		fftpitch_free(fp);
+		return -1;
+	}
+	for (i = 0; i < frames; i++) {
+		fp->window_sum += fp->window[i];
+	}
+	n = fp->size;
+	fp->plan_one = fftwf_plan_dft_r2c_1d(n, fp->in, fp->out, FFTW_MEASURE);
+	fp->plan_batch = fftwf_plan_many_dft_r2c(1, &n, FFTPITCH_BATCH, fp->in, NULL, 1, n,
+			fp->out, NULL, 1, n / 2 + 1, FFTW_MEASURE);
+	if (fp->plan_one == NULL || fp->plan_batch == NULL) {
+		fftpitch_free(fp);
+		return -1;
+	}
+	return 0;
+}
+
+void fftpitch_free(fftpitch_t * fp) {
+	if (fp->plan_one != NULL) {
+		fftwf_destroy_plan(fp->plan_one);
+	}
+	if (fp->plan_batch != NULL) {
+		fftwf_destroy_plan(fp->plan_batch);
+	}
+	if (fp->in != NULL) {
+		fftwf_free(fp->in);
+	}
+	if (fp->out != NULL) {
+		fftwf_free(fp->out);
+	}
+	free(fp->window);
+	free(fp->sub_window);
+	memset(fp, 0, sizeof(fftpitch_t));
+}
+
+// Windowed, zero-padded copy of `hop` into `dst`
+static void load_hop(fftpitch_t * fp, float * dst, const sample_t * hop) {
+	unsigned int i;
+	for (i = 0; i < fp->frames; i++) {
+		dst[i] = hop[i] * fp->window[i];
+	}
+	memset(dst + fp->frames, 0, (fp->size - fp->frames) * sizeof(float));
+}
+
+// Phase of the windowed DTFT of `x` at `w` radians per sample
+static double phase_at(const float * window, unsigned int n, const sample_t * x, double w) {
+	double re = 0, im = 0, pr = 1, pi = 0;
+	double cr = cos(w), ci = -sin(w), t;
+	unsigned int i;
+	for (i = 0; i < n; i++) {
+		re += window[i] * x[i] * pr;
+		im += window[i] * x[i] * pi;
+		t = pr * cr - pi * ci;
+		pi = pr * ci + pi * cr;
+		pr = t;
+	}
+	return atan2(im, re);
+}
+
+// Peak of one transformed hop between bins `lo` and `hi`, refined as
+// described in fftpitch.h. Its amplitude goes in `amp`, if given.
+static float peak_frequency(fftpitch_t * fp, const fftwf_complex * bins, const sample_t * hop,
+		unsigned int lo, unsigned int hi, float * amp) {
+	unsigned int k, best = lo;
+	float best_mag = -1, bin_hz = (float) fp->sample_rate / fp->size;
+	double a, b, c, p = 0, f, w, dphi;
+	for (k = lo; k <= hi; k++) {
+		float mag = bins[k][0] * bins[k][0] + bins[k][1] * bins[k][1];
+		if (mag > best_mag) {
+			best_mag = mag;
+			best = k;
+		}
+	}
+	if (best_mag <= 0) {
+		if (amp != NULL) {
+			*amp = 0;
+		}
+		return lo * bin_hz;
+	}
+	// Parabola through the log magnitudes around the peak
+	a = log(bins[best - 1][0] * bins[best - 1][0] + bins[best - 1][1] * bins[best - 1][1] + 1e-30);
+	b = log(best_mag + 1e-30);
+	c = log(bins[best + 1][0] * bins[best + 1][0] + bins[best + 1][1] * bins[best + 1][1] + 1e-30);
+	if (a - 2 * b + c < 0) {
+		p = 0.5 * (a - c) / (a - 2 * b + c);
+	}
+	f = (best + p) * bin_hz;
+	if (amp != NULL) {
+		// Height of the parabola, undoing the window's gain
+		*amp = 2 * exp(0.5 * (b - 0.25 * (a - c) * p)) / fp->window_sum;
+	}
+
+	// Phase vocoder | Only once the tone is clear of its negative image
+	if (fp->sub_hop == 0 || f < 2.0 * fp->sample_rate / fp->sub_frames) {
+		return f;
+	}
+	w = 2 * PI * f / fp->sample_rate;
+	dphi = phase_at(fp->sub_window, fp->sub_frames, hop + fp->sub_hop, w)
+		- phase_at(fp->sub_window, fp->sub_frames, hop, w) - w * fp->sub_hop;
+	dphi -= 2 * PI * floor(dphi / (2 * PI) + 0.5);
+	w += dphi / fp->sub_hop;
+	// Trust the refinement only if it stays near the parabolic estimate
+	if (fabs(w * fp->sample_rate / (2 * PI) - f) > 2 * bin_hz) {
+		return f;
+	}
+	return w * fp->sample_rate / (2 * PI);
+}
+
+void fftpitch_estimate(fftpitch_t * fp, const sample_t * hops, unsigned int count, float * freqs) {
+	unsigned int i, b, n, bins = fp->size / 2 + 1;
+	for (i = 0; i < count; i += n) {
+		n = count - i < FFTPITCH_BATCH ? count - i : FFTPITCH_BATCH;
+		// The batched plan always transforms every slot, so a short tail
+		// goes one hop at a time
+		if (n < FFTPITCH_BATCH) {
+			for (b = 0; b < n; b++) {
+				load_hop(fp, fp->in, hops + (size_t) (i + b) * fp->frames);
+				fftwf_execute(fp->plan_one);
+				freqs[i + b] = peak_frequency(fp, fp->out, hops + (size_t) (i + b) * fp->frames,
+						fp->lo_bin, fp->hi_bin, NULL);
+			}
+			continue;
+		}
+		for (b = 0; b < n; b++) {
+			load_hop(fp, fp->in + b * fp->size, hops + (size_t) (i + b) * fp->frames);
+		}
+		fftwf_execute(fp->plan_batch);
+		for (b = 0; b < n; b++) {
+			freqs[i + b] = peak_frequency(fp, fp->out + b * bins, hops + (size_t) (i + b) * fp->frames,
+					fp->lo_bin, fp->hi_bin, NULL);
+		}
+	}
+}
+
+void fftpitch_bands(fftpitch_t * fp, const sample_t * hop, unsigned int lanes, float * freqs, float * amps) {
+	float width = (fp->upper - fp->lower) / lanes;
+	unsigned int l, lo, hi;
+	load_hop(fp, fp->in, hop);
+	fftwf_execute(fp->plan_one);
+	for (l = 0; l < lanes; l++) {
+		lo = (fp->lower + l * width) * fp->size / fp->sample_rate;
+		hi = (fp->lower + (l + 1) * width) * fp->size / fp->sample_rate;
+		if (lo < fp->lo_bin) {
+			lo = fp->lo_bin;
+		}
+		if (hi > fp->hi_bin) {
+			hi = fp->hi_bin;
+		}
+		if (hi < lo) {
+			hi = lo;
+		}
+		freqs[l] = peak_frequency(fp, fp->out, hop, lo, hi, &amps[l]);
+	}
+}
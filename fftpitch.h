@@ -0,0 +1,61 @@
+// fftpitch.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// Frequency estimation for hops known to hold a single tone within
+// [lower_bounds, lower_bounds + pitch_scale]. Each hop is windowed, zero
+// padded and transformed with a reusable FFTW plan; the strongest bin in
+// range is refined by parabolic interpolation, then by the phase advance
+// between two overlapping halves of the hop when the hop is long enough
+// to separate the tone from its negative-frequency image.
+#ifndef FFTPITCH_H
+#define FFTPITCH_H
+
+#include <fftw3.h>
+#include "sonify.h"
+
+// Hops transformed per FFTW call by fftpitch_estimate(); a shorter tail
+// goes one hop at a time
+#define FFTPITCH_BATCH 32
+
+typedef struct {
+	unsigned int frames;		// samples per hop
+	unsigned int size;		// FFT length, at least 8 * frames
+	unsigned int lo_bin, hi_bin;	// bins searched for the peak
+	float lower, upper;
+	unsigned int sample_rate;
+	float * window;			// Hann window, `frames` long
+	float window_sum;
+	float * sub_window;		// Hann window for the phase vocoder halves
+	unsigned int sub_frames, sub_hop;
+	float * in;			// FFTPITCH_BATCH * size samples
+	fftwf_complex * out;		// FFTPITCH_BATCH * (size / 2 + 1) bins
+	fftwf_plan plan_one, plan_batch;
+} fftpitch_t;
+
+// Not thread-safe, as FFTW planning is not. Returns 0 on success.
+int fftpitch_init(fftpitch_t * fp, unsigned int sample_rate, unsigned int frames, float lower, float upper);
+void fftpitch_free(fftpitch_t * fp);
+
+// Estimate the frequency of `count` hops stored back to back in `hops`
+void fftpitch_estimate(fftpitch_t * fp, const sample_t * hops, unsigned int count, float * freqs);
+
+// Multi-tone | Frequency and amplitude of the strongest tone in each of
+// `lanes` equal sub-bands of the range, from a single FFT of `hop`
+void fftpitch_bands(fftpitch_t * fp, const sample_t * hop, unsigned int lanes, float * freqs, float * amps);
+
+#endif
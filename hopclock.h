@@ -0,0 +1,74 @@
+// hopclock.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// Where each pixel starts and ends, in frames. A pixel of `ms_time` lasts
+// `sample_rate * ms_time / 1000` frames, which is rarely a whole number
+// (44.1 at 44.1 kHz and 1 ms), so pixels are a frame longer or shorter
+// as needed to stay on time: pixel k starts at floor(k * frames per
+// pixel), to within 2^-32 of a frame. The encoder, the JACK client and
+// the decoder all count pixels this way, so they agree on where every
+// pixel starts.
+#ifndef HOPCLOCK_H
+#define HOPCLOCK_H
+
+#include <stdint.h>
+
+typedef struct {
+	uint64_t step;			// frames per pixel, 32.32 fixed point
+	uint32_t frac;			// how far into its first frame the next pixel starts
+} hopclock_t;
+
+// Pixels of `ms_time` milliseconds, at least a frame long each. Returns 0,
+// or -1 if `ms_time` is not positive.
+static inline int hopclock_init(hopclock_t * clock, unsigned int sample_rate, double ms_time) {
+	double frames = sample_rate * 0.001 * ms_time;
+	if (!(ms_time > 0)) {
+		return -1;
+	}
+	if (frames < 1) {
+		frames = 1;
+	}
+	clock->step = (uint64_t) (frames * 4294967296.0 + 0.5);
+	clock->frac = 0;
+	return 0;
+}
+
+// Frames in the shortest pixel. Only this many of each pixel are captured
+// and analyzed, so every hop the detector sees is the same size.
+static inline unsigned int hopclock_frames(const hopclock_t * clock) {
+	return clock->step >> 32;
+}
+
+// Frames in the next pixel: hopclock_frames() or one more
+static inline unsigned int hopclock_next(hopclock_t * clock) {
+	uint64_t end = clock->frac + clock->step;
+	clock->frac = (uint32_t) end;
+	return end >> 32;
+}
+
+// First frame of pixel `k`, counting from the start of the clock
+static inline uint64_t hopclock_offset(const hopclock_t * clock, uint64_t k) {
+	return k * (clock->step >> 32) + ((k * (uint32_t) clock->step) >> 32);
+}
+
+// Whole pixels in the first `frames` frames, for fewer than 2^32 frames
+static inline uint64_t hopclock_pixels(const hopclock_t * clock, uint64_t frames) {
+	return (((frames + 1) << 32) - 1) / clock->step;
+}
+
+#endif
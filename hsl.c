@@ -0,0 +1,144 @@
+// hsl.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include "hsl.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HSL_X86 1
+#include <emmintrin.h>
+#endif
+
+// 1 / C for every chroma C an 8-bit pixel can have, so hues cost a
+// multiply instead of a divide
+#define HSL_INV4(n) 1.0f / (n), 1.0f / ((n) + 1), 1.0f / ((n) + 2), 1.0f / ((n) + 3)
+#define HSL_INV16(n) HSL_INV4(n), HSL_INV4((n) + 4), HSL_INV4((n) + 8), HSL_INV4((n) + 12)
+#define HSL_INV64(n) HSL_INV16(n), HSL_INV16((n) + 16), HSL_INV16((n) + 32), HSL_INV16((n) + 48)
+static const float hsl_inv[256] = {
+	0, 1.0f, 1.0f / 2, 1.0f / 3, HSL_INV4(4), HSL_INV4(8), HSL_INV4(12),
+	HSL_INV16(16), HSL_INV16(32), HSL_INV16(48),
+	HSL_INV64(64), HSL_INV64(128), HSL_INV64(192)
+};
+
+void hsl_from_rgb_row(const uint32_t * in, int n, const hsl_layout_t * layout, float * hue, float * light) {
+	int i;
+	for (i = 0; i < n; i++) {
+		int r = (in[i] >> layout->rshift) & 0xff;
+		int g = (in[i] >> layout->gshift) & 0xff;
+		int b = (in[i] >> layout->bshift) & 0xff;
+		int hi = r > g ? r : g, lo = r < g ? r : g, c;
+		hi = hi > b ? hi : b;
+		lo = lo < b ? lo : b;
+		c = hi - lo;
+		light[i] = (hi + lo) * (1.0f / 510);
+		// Sextant of the hue circle, then how far along it
+		if (c == 0) {
+			hue[i] = 0;
+		} else if (hi == r) {
+			hue[i] = ((g < b ? 6 : 0) + (g - b) * hsl_inv[c]) * (1.0f / 6);
+		} else if (hi == g) {
+			hue[i] = (2 + (b - r) * hsl_inv[c]) * (1.0f / 6);
+		} else {
+			hue[i] = (4 + (r - g) * hsl_inv[c]) * (1.0f / 6);
+		}
+	}
+}
+
+// HSL to RGB by formula rather than by sextant: channel `n` (0 red, 8
+// green, 4 blue) at `h12` twelfths of the way round the hue circle
+static inline float hsl_channel(float h12, float light, float a, float n) {
+	float k = n + h12, m;
+	k -= 12 * (k >= 12);
+	m = k - 3 < 9 - k ? k - 3 : 9 - k;
+	m = m < 1 ? m : 1;
+	m = m > -1 ? m : -1;
+	return light - a * m;
+}
+
+static inline uint32_t hsl_byte(float v) {
+	v = v * 255 + 0.5f;
+	return v <= 0 ? 0 : v >= 255 ? 255 : (uint32_t) v;
+}
+
+static void hsl_to_rgb_c(const float * hue, const float * light, int n, const hsl_layout_t * layout, uint32_t * out) {
+	int i;
+	for (i = 0; i < n; i++) {
+		float h = hue[i], l = light[i], a = l < 1 - l ? l : 1 - l;
+		int whole;
+		// Wrap; anything silly (including NaN) is red
+		if (!(h > -1e6f && h < 1e6f)) {
+			h = 0;
+		}
+		whole = (int) h;
+		h -= whole > h ? whole - 1 : whole;
+		h *= 12;
+		out[i] = hsl_byte(hsl_channel(h, l, a, 0)) << layout->rshift |
+			hsl_byte(hsl_channel(h, l, a, 8)) << layout->gshift |
+			hsl_byte(hsl_channel(h, l, a, 4)) << layout->bshift | layout->alpha;
+	}
+}
+
+#ifdef HSL_X86
+__attribute__((target("sse2")))
+static inline __m128 hsl_channel_sse2(__m128 h12, __m128 light, __m128 a, float n) {
+	const __m128 twelve = _mm_set1_ps(12), one = _mm_set1_ps(1);
+	__m128 k = _mm_add_ps(h12, _mm_set1_ps(n)), m;
+	k = _mm_sub_ps(k, _mm_and_ps(_mm_cmpge_ps(k, twelve), twelve));
+	m = _mm_min_ps(_mm_sub_ps(k, _mm_set1_ps(3)), _mm_sub_ps(_mm_set1_ps(9), k));
+	m = _mm_max_ps(_mm_min_ps(m, one), _mm_set1_ps(-1));
+	return _mm_sub_ps(light, _mm_mul_ps(a, m));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i hsl_byte_sse2(__m128 v, int shift) {
+	v = _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(255)), _mm_set1_ps(0.5f));
+	v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255));
+	return _mm_sll_epi32(_mm_cvttps_epi32(v), _mm_cvtsi32_si128(shift));
+}
+
+// SSE2 | Four pixels at a time
+__attribute__((target("sse2")))
+static void hsl_to_rgb_sse2(const float * hue, const float * light, int n, const hsl_layout_t * layout, uint32_t * out) {
+	const __m128 one = _mm_set1_ps(1);
+	const __m128i alpha = _mm_set1_epi32(layout->alpha);
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 h = _mm_loadu_ps(hue + i), l = _mm_loadu_ps(light + i);
+		__m128 a = _mm_min_ps(l, _mm_sub_ps(one, l)), whole;
+		__m128i px;
+		h = _mm_and_ps(h, _mm_and_ps(_mm_cmpgt_ps(h, _mm_set1_ps(-1e6f)), _mm_cmplt_ps(h, _mm_set1_ps(1e6f))));
+		whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(h));
+		whole = _mm_sub_ps(whole, _mm_and_ps(_mm_cmpgt_ps(whole, h), one));
+		h = _mm_mul_ps(_mm_sub_ps(h, whole), _mm_set1_ps(12));
+		px = _mm_or_si128(hsl_byte_sse2(hsl_channel_sse2(h, l, a, 0), layout->rshift),
+				hsl_byte_sse2(hsl_channel_sse2(h, l, a, 8), layout->gshift));
+		px = _mm_or_si128(px, hsl_byte_sse2(hsl_channel_sse2(h, l, a, 4), layout->bshift));
+		_mm_storeu_si128((__m128i *) (out + i), _mm_or_si128(px, alpha));
+	}
+	hsl_to_rgb_c(hue + i, light + i, n - i, layout, out + i);
+}
+#endif
+
+void hsl_to_rgb_row(const float * hue, const float * light, int n, const hsl_layout_t * layout, uint32_t * out) {
+#ifdef HSL_X86
+	if (__builtin_cpu_supports("sse2")) {
+		hsl_to_rgb_sse2(hue, light, n, layout, out);
+		return;
+	}
+#endif
+	hsl_to_rgb_c(hue, light, n, layout, out);
+}
@@ -0,0 +1,41 @@
+// hsl.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// Whole rows of packed 32-bit pixels to and from hue and lightness, for
+// turning images into tones and decoded tones back into pixels. These
+// agree with Rgb2Hsl() and Hsl2Rgb() in color_util.h (at S = 1 on the way
+// back) to within float rounding.
+#ifndef HSL_H
+#define HSL_H
+
+#include <stdint.h>
+
+// Where the 8-bit channels sit in a packed pixel; `alpha` is ORed into
+// every pixel written
+typedef struct {
+	int rshift, gshift, bshift;
+	uint32_t alpha;
+} hsl_layout_t;
+
+// Hue in [0, 1) and lightness in [0, 1] of `n` pixels
+void hsl_from_rgb_row(const uint32_t * in, int n, const hsl_layout_t * layout, float * hue, float * light);
+// Fully saturated pixels for `n` hues and lightnesses. Hues wrap; the
+// channels are rounded and clamped to [0, 255].
+void hsl_to_rgb_row(const float * hue, const float * light, int n, const hsl_layout_t * layout, uint32_t * out);
+
+#endif
@@ -0,0 +1,45 @@
+// image.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <stdio.h>
+#include "image.h"
+
+int image_open(image_t * image, const char * path, const char * map_path, int whole, int feedback_channels) {
+	image->feedback_mode = feedback_channels > 0;
+	if (tonemap_start(&image->map, path, map_path) != 0) {
+		return -1;
+	}
+	// Feedback mode plays a writable copy of the whole map
+	if ((whole || image->feedback_mode) && tonemap_finish(&image->map) != 0) {
+		tonemap_close(&image->map);
+		return -1;
+	}
+	if (image->feedback_mode && feedback_init(&image->feedback, &image->map, feedback_channels) != 0) {
+		fprintf(stderr,"memory allocation failed\n");
+		tonemap_close(&image->map);
+		return -1;
+	}
+	return 0;
+}
+
+void image_close(image_t * image) {
+	if (image->feedback_mode) {
+		feedback_free(&image->feedback);
+	}
+	tonemap_close(&image->map);
+}
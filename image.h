@@ -0,0 +1,47 @@
+// image.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// An image sonify plays: its tone map and, in feedback mode, the decoded
+// pixels played in its place. Patches (patch.h) point at the image they
+// play; the control thread (control.h) owns them all and closes one only
+// once nothing can be reading it.
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "tonemap.h"
+#include "feedback.h"
+
+typedef struct image {
+	tonemap_t map;
+	int feedback_mode;
+	feedback_t feedback;		// feedback mode only
+} image_t;
+
+// Map the tones of the image at `path`, as tonemap_start() does. With
+// `whole`, wait until they are all built. With `feedback_channels` (> 0),
+// wait anyway and start feedback buffers fed from that many stripes.
+// Returns 0 on success, -1 after printing why not.
+int image_open(image_t * image, const char * path, const char * map_path, int whole, int feedback_channels);
+void image_close(image_t * image);
+
+// What to play instead of the tone map, or NULL
+static inline const feedback_t * image_feedback(const image_t * image) {
+	return image->feedback_mode ? &image->feedback : NULL;
+}
+
+#endif
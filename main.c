@@ -21,227 +21,331 @@
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
-// Jack & Aubio
+// Jack
 #include <jack/jack.h>
-#include <aubio/aubio.h>
 // SDL Includes
-#include <SDL_image.h>
 #include <SDL.h>
 #include "resize.h"
 // 
+#include "sonify.h"
 #include "math_util.h"
 #include "color_util.h"
+#include "tones.h"
+#include "image.h"
+#include "wavebank.h"
+#include "render.h"
+#include "engine.h"
+#include "analysis.h"
+#include "bands.h"
+#include "cache.h"
+#include "stats.h"
+#include "control.h"
 
-// Global Vars 
-int image_tones_size, image_tones_index = 0, framecount;
-long offset = 0;
-float hopsize, max_amp = 0;
-// ???: What if amp were a double?
-float * image_tones, * image_tones_amp;
-int X = 0, Y = 0;
-
-const double PI = 3.14;
-enum TYPE { Sine = 0, Square, Triangle, Sawtooth };
+// Longest ms time a running instance can change to, unless it started
+// with a longer one; hop slots are allocated for this many
+#define MAX_HOP_MS 20
 
-// Aubio Global Vars
-aubio_pitchdetection_t * aubio;
-fvec_t * aubio_fvec;
+// Global Vars 
+int image_tones_size;
+// The image on screen, and the order its pixels are played in, as every
+// patch plays them. The control thread owns the image; we tell it when we
+// move on to another (see show_image()).
+image_t * shown_image;
+tone_table_t tone_table;
+// Feedback mode | Decoded pixels overwrite the tones; see feedback.h
+int feedback_mode = 0;
 
 // User-Provided Vars
 int pitch_scale, lower_bounds;
 float ms_time;
 enum TYPE waveform_type = Sine;
+enum METHOD detector_method = Fcomb;
+int tone_lanes = 1;
+int channels = 1;
+int window_scale;
+// Pixels in each channel's stripe of the image
+int stripe_pixels;
 
 // SDL Surfaces
-SDL_Surface * source_image, * dest_image, * dub_image;
+SDL_Surface * dest_image;
+SDL_Surface * display;
 
-// Jack
-typedef jack_default_audio_sample_t sample_t;
-jack_port_t *output_port;
-jack_port_t *input_port;
-
-// Waveform Synthesis Vars
-sample_t * cycle, * temp_cycle;
-jack_nframes_t sample_rate, samples_per_cycle, temp_samples_per_cycle;
-
-// Aubio | Init pitch detection & aubio_fvec
-// ???: What is `hopsize` exactly?
-//      What about `aubio_pitch_fcomb`?
-//      Bufsize?
-void init_aubio(jack_nframes_t sr) {
-	hopsize = sr * 0.001 * ms_time;
-	float bufsize = sizeof(sample_t) * hopsize;
-	aubio = new_aubio_pitchdetection(bufsize, hopsize, 1, sr, aubio_pitch_fcomb, aubio_pitchm_freq);
-	aubio_fvec = new_fvec(hopsize, 1);
-}
+// Display | Rows of dest_image changed since the last frame, and how often
+// we redraw them
+unsigned char * dirty_rows;
+int fps = 60;
+// Where to keep the tone map between runs, if not in the cache
+char * tonemap_path = NULL;
+const char * cache_dir;
+// Where to export timing stats, if anywhere, and how often
+char * stats_path = NULL;
+int stats_period = 1000;
+// A FIFO to read commands from (control.h), if any
+char * control_path = NULL;
 
-// Jack | Sample rate callback
+// Jack | One pair per channel
+jack_port_t *output_port[MAX_CHANNELS];
+jack_port_t *input_port[MAX_CHANNELS];
+
+// Waveform Synthesis Vars | Everything process() plays and captures
+engine_t engine;
+jack_nframes_t sample_rate;
+
+// Jack | Sample rate callback. Everything that depends on the rate is
+// rebuilt by the control thread and swapped in whole; see control.h.
 int srate(jack_nframes_t nframes, void * arg) {
 	printf("the sample rate is now %lu/sec\n", (long) nframes);
-	sample_rate = nframes;
+	__atomic_store_n(&sample_rate, nframes, __ATOMIC_RELAXED);
+	control_set_rate(nframes);
 	return 0;
 }
 
-// SDL | Write RGB val to surface at current (X,Y)
-void write_to_image(SDL_Surface *image, float R, float G, float B) {
+// SDL | Write packed pixel `color` to surface at the (X,Y) of pixel
+// `index`. Returns the row of `image` that changed.
+int write_to_image(SDL_Surface *image, unsigned int index, Uint32 color) {
 	int w = image->w;
 	int h = image->h;
-	if (X == w) {
-		X = 0;
-		Y++;
+	int X = index % w;
+	int Y = (index / w) % h;
+	((Uint32 *) ((Uint8 *) image->pixels + Y * image->pitch))[X] = color;
+	return Y;
+}
+
+// Pixels converted per call to hsl_to_rgb_row()
+#define DRAW_BATCH 64
+
+// SDL | Write every pixel the analysis worker has decoded so far from the
+// image on screen. Returns the image the next pixel is from, if another.
+image_t * draw_pixels(SDL_Surface *image) {
+	image_t * next = NULL;
+	pixel_t * px;
+	float hue[DRAW_BATCH], light[DRAW_BATCH];
+	unsigned int where[DRAW_BATCH], channel[DRAW_BATCH];
+	Uint32 colors[DRAW_BATCH];
+	hsl_layout_t layout = surface_layout(image);
+	int n, i;
+	stats_record(StatPixelFill, ring_fill(&pixel_ring));
+	if SDL_MUSTLOCK(image) SDL_LockSurface(image);
+	do {
+		for (n = 0; n < DRAW_BATCH && (px = (pixel_t *) ring_read_slot(&pixel_ring)) != NULL; n++) {
+			if (px->image != shown_image) {
+				next = px->image;
+				break;
+			}
+			hue[n] = px->h;
+			light[n] = px->l;
+			where[n] = px->channel * stripe_pixels + px->index % stripe_pixels;
+			channel[n] = px->channel;
+			ring_release(&pixel_ring);
+		}
+		hsl_to_rgb_row(hue, light, n, &layout, colors);
+		for (i = 0; i < n; i++) {
+			dirty_rows[write_to_image(image, where[i], colors[i])] = 1;
+			if (feedback_mode) {
+				feedback_write(&shown_image->feedback, channel[i], where[i], hue[i], light[i]);
+			}
+		}
+	} while (n == DRAW_BATCH);
+	if SDL_MUSTLOCK(image) SDL_UnlockSurface(image);
+	return next;
+}
+
+// SDL | A blank dest_image the size of the image on screen, with every row
+// due to be drawn
+void create_surface() {
+	dest_image = SDL_CreateRGBSurface (SDL_SWSURFACE, shown_image->map.width, shown_image->map.height, 32, 0, 0, 0, 0);
+	if(dest_image == NULL) {
+		fprintf(stderr, "CreateRGBSurface failed: %s\n", SDL_GetError());
+		exit(1);
 	}
-	// ???: `h * 4` instead of `h`
-	if (Y == h * 4) {
-		Y = 0;
+	dirty_rows = (unsigned char *) malloc(dest_image->h);
+	if (dirty_rows == NULL) {
+		fprintf(stderr,"memory allocation failed\n");
+		exit(3);
 	}
-	// TODO: Uint32_t support?
-	//       After all, our surfaces are 32-bit
-	uint8_t color = SDL_MapRGB(image->format, (uint8_t) (R * 255.0), (uint8_t) (G * 255.0), (uint8_t) (B * 255.0));
-	uint8_t * pixels = (uint8_t *) image->pixels;
-	pixels[(Y * w) + X] = color;
-	X++;
+	memset(dirty_rows, 1, dest_image->h);
 }
 
-void swap_cycle();
-
-// Build a waveform of type `type` with frequency `t` and amplitude `a` in `temp_cycle`, 
-// Then call swap_cycle() to replace `cycle` with `temp_cycle`. 
-void build_tone(float t, float a, enum TYPE type) {
-	temp_samples_per_cycle = (sample_rate / t);
-	sample_t scale = 2 * PI / temp_samples_per_cycle;
-	temp_cycle = (sample_t *) malloc(temp_samples_per_cycle * sizeof(sample_t));
-	
-	if (temp_cycle == NULL) {
-		fprintf(stderr,"Memory allocation failed.\n");
-		exit(3);
+// SDL | Draw the pixels of `next` from now on, in a window resized to fit
+// it, and let the control thread close the image before
+void show_image(image_t * next) {
+	shown_image = next;
+	image_tones_size = tone_table_init(&tone_table, &next->map, channels, tone_lanes, pitch_scale, lower_bounds);
+	stripe_pixels = image_tones_size / channels;
+	SDL_FreeSurface(dest_image);
+	free(dirty_rows);
+	create_surface();
+	display = SDL_SetVideoMode(dest_image->w * window_scale, dest_image->h * window_scale, 32, SDL_SWSURFACE);
+	if (display == NULL) { 
+		fprintf(stderr, "SetVideoMode failed: %s\n", SDL_GetError()); 
+		exit(1);
 	}
-	
-	int i;
-	for (i = 0; i < temp_samples_per_cycle; i++) {
-		switch(type) {
-			case Sine:
-				temp_cycle[i] = a * sin(i * scale);
-				break;
-			case Square:
-				temp_cycle[i] = a * sgn(sin(i * scale));
-				break;
-			case Triangle:
-				temp_cycle[i] = a * (asin(sin(i * scale)) / (PI / 2));
-				break;
-			case Sawtooth:
-				temp_cycle[i] = a * (2 * ((((float) i) / temp_samples_per_cycle) - floor(((float) i) / temp_samples_per_cycle)) - 1);
-				break;
+	control_shown(next);
+}
+
+// SDL | Rescale each run of dirty rows of `image` into `display` and
+// update just that part of the screen
+void redraw_dirty(SDL_Surface *display, SDL_Surface *image) {
+	SDL_Rect changed;
+	int y = 0, end;
+	while (y < image->h) {
+		if (!dirty_rows[y]) {
+			y++;
+			continue;
 		}
+		for (end = y; end < image->h && dirty_rows[end]; end++) {
+			dirty_rows[end] = 0;
+		}
+		if (SDL_ResizeRowsInto(image, display, y, end, 1, &changed) != 0) {
+			fprintf(stderr, "SDL_ResizeRowsInto() Failed.\n");
+			exit(1);
+		}
+		SDL_UpdateRect(display, changed.x, changed.y, changed.w, changed.h);
+		y = end;
 	}
-	swap_cycle();
 }
 
-// Swap `cycle` for what we've built in `temp_cycle`
-void swap_cycle() {
-	if (cycle != NULL) {
-		sample_t * trash = cycle;
-		cycle = temp_cycle;
-		free(trash);
-	} else {
-		cycle = temp_cycle;
+// Page in the next second or so of every stripe, so that process() finds
+// the tone map in memory when it gets there
+void page_ahead() {
+	int index = engine_index(&engine);
+	unsigned int ahead = (control_pixel_rate() + 1) * tone_lanes;
+	int c;
+	// In feedback mode the map was read in full when it was copied
+	if (feedback_mode) {
+		return;
+	}
+	for (c = 0; c < channels; c++) {
+		tonemap_willneed(&shown_image->map, tone_table_pixel(&tone_table, index + c * tone_lanes), ahead);
 	}
-	temp_cycle = NULL;
-	samples_per_cycle = temp_samples_per_cycle;
-	// Reset our offset to the beginnig of our new cycle
-	// TODO: What does `offset = offest % samples_per_cycle`
-	//       sound like? Would this afford a smoother
-	//       transition for cycles of similar frequency?
-	offset = 0;
+}
+
+// Jack | Xrun Callback
+int xrun(void * arg) {
+	stats_add(StatXruns, 1);
+	return 0;
 }
 
 // Jack | Process Callback
 int process(jack_nframes_t nframes, void *arg) {
-	sample_t * in = (sample_t *) jack_port_get_buffer(input_port, nframes);
-	sample_t * out = (sample_t *) jack_port_get_buffer(output_port, nframes);
-	if (aubio_fvec == NULL || aubio_fvec->data == NULL) {
-		init_aubio(sample_rate);
-	}
-	// 
-	jack_nframes_t i;
-	for (i = 0; i < nframes; i++) {
-		// ???: What is the significance of `framecount == hopsize`? 
-		if (framecount == hopsize) {
-			image_tones_index++;
-			if (image_tones_index >= image_tones_size) {
-				image_tones_index = 0;
-			}
-			// Build waveform for the next pixel of our original image
-			// TODO: Consider a "feedback" mode.
-			build_tone(image_tones[image_tones_index], 1 - image_tones_amp[image_tones_index], waveform_type);
-			// Write_to_image() according to analyzed samples 
-			// TODO: How often are the vars below redeclared?
-			float H, S, L, R, G, B;
-			Sound2Hsl(&H, &S, &L, aubio_pitchdetection(aubio, aubio_fvec), max_amp, pitch_scale, lower_bounds);
-			Hsl2Rgb(&R, &G, &B, H, S, 1 - L);
-			write_to_image(dest_image, R, G, B);
-			framecount = 0;
-			max_amp = 0;
-		}
-		out[i] = cycle[offset];
-		// !!!:
-		aubio_fvec->data[0][framecount] = (smpl_t) in[i];
-		if (fabs(in[i]) > max_amp) {
-			max_amp = fabs(in[i]);
-		}
-		offset++;
-		if (offset == samples_per_cycle) {
-			offset = 0;
-		}
-		framecount++;
+	sample_t * in[MAX_CHANNELS], * out[MAX_CHANNELS];
+	int c;
+	for (c = 0; c < channels; c++) {
+		in[c] = (sample_t *) jack_port_get_buffer(input_port[c], nframes);
+		out[c] = (sample_t *) jack_port_get_buffer(output_port[c], nframes);
 	}
+	engine_process(&engine, in, out, nframes);
 	return 0;      
 }
 
-// Call this upon loading our image. Build arrays containing frequency and
-// amplitude values calculated from the hue and luminance components of
-// each pixel in our image, respectively.
-// TODO: Right now it doesn't make sense to call build_tone() in process()
-//       unless our sample rate changes (I'm not even sure if Jack allows
-//       for this). Unless we implement a "feedback mode" where `image_tones`
-//       is overwritten with incoming pixel data, we could instead generate
-//       an array of cycles `image_cycles` where:
-//       	image_cycles[c] = build_tone(H * pitch_scale + lower_bounds, L, waveform_type);
-//	 or whatever the correct code would be...
-void generate_tone_array(SDL_Surface *image) {
-	int w, h, x, y, p, c = 0;
-	w = image->w;
-	h = image->h * 4;
-	image_tones_size = w * h;
-	image_tones = (float *) malloc(w * h * sizeof(float));
-	image_tones_amp = (float *) malloc(w * h * sizeof(float));
-	if (image_tones == NULL || image_tones_amp == NULL) {
-		fprintf(stderr,"memory allocation failed\n");
-		exit(3);
+// SDL | The command for a key, or NULL: arrows move the frequency range,
+// brackets halve and double the time per pixel, 1 to 4 pick a waveform and
+// d switches detector
+const char * key_command(SDLKey key) {
+	switch (key) {
+		case SDLK_UP: return "scale +1000";
+		case SDLK_DOWN: return "scale -1000";
+		case SDLK_RIGHT: return "lower +100";
+		case SDLK_LEFT: return "lower -100";
+		case SDLK_LEFTBRACKET: return "ms /2";
+		case SDLK_RIGHTBRACKET: return "ms *2";
+		case SDLK_1: return "wave sin";
+		case SDLK_2: return "wave sq";
+		case SDLK_3: return "wave tri";
+		case SDLK_4: return "wave saw";
+		case SDLK_d: return "detector toggle";
+		default: return NULL;
 	}
-	for (y = 0; y < h; y++) {
-		for (x = 0; x < w; x++) {
-			color rgb = get_color(image, x, y);
-			float H, S, L;
-			Rgb2Hsl(&H, &S, &L, (float) (rgb.r / 255.0), (float) (rgb.g / 255.0), (float) (rgb.b / 255.0));
-			image_tones[c] = H * pitch_scale + lower_bounds; // Hue = Frequency
-			image_tones_amp[c] = L; // Luminosity = Amplitude
-			c++;
+}
+
+// Jack | "input" and "output", or "input_1", "output_1", ... for several
+// channels
+void register_ports(jack_client_t * client) {
+	char name[32];
+	int c;
+	for (c = 0; c < channels; c++) {
+		if (channels == 1) {
+			strcpy(name, "input");
+		} else {
+			sprintf(name, "input_%d", c + 1);
+		}
+		input_port[c] = jack_port_register(client, name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+		if (channels == 1) {
+			strcpy(name, "output");
+		} else {
+			sprintf(name, "output_%d", c + 1);
 		}
+		output_port[c] = jack_port_register(client, name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
 	}
 }
 
 // Handle our-user provided vars
-void init_vars(char * argv[], char file_name[], int * window_scale) {
+void init_vars(int argc, char * argv[], char file_name[], int * window_scale) {
+	int i;
 	strcpy(file_name, argv[2]);
 	pitch_scale = atoi(argv[3]);
 	lower_bounds = atoi(argv[4]);
-	ms_time = atoi(argv[5]);
-	if (strcmp(argv[6], "sin")==0) { waveform_type = 0; }
-	else if (strcmp(argv[6], "sq")==0) { waveform_type = 1; }
-	else if (strcmp(argv[6], "tri")==0) { waveform_type = 2; }
-	else { waveform_type = 3; }
+	// Fractions of a millisecond are fine; see hopclock.h
+	ms_time = atof(argv[5]);
+	if (ms_time <= 0) {
+		fprintf(stderr, "ms time must be more than 0\n");
+		exit(1);
+	}
+	waveform_type = parse_waveform(argv[6]);
 	*window_scale = atoi(argv[7]);
+	cache_dir = cache_default_dir();
+	// Options following the required arguments
+	for (i = 8; i < argc; i++) {
+		if (strcmp(argv[i], "--detector")==0 && i + 1 < argc && parse_method(argv[i + 1]) >= 0) {
+			detector_method = parse_method(argv[++i]);
+		} else if (strcmp(argv[i], "--fps")==0 && i + 1 < argc) {
+			fps = atoi(argv[++i]);
+			if (fps < 1) {
+				fprintf(stderr, "--fps must be at least 1\n");
+				exit(1);
+			}
+		} else if (strcmp(argv[i], "--channels")==0 && i + 1 < argc) {
+			channels = atoi(argv[++i]);
+			if (channels < 1 || channels > MAX_CHANNELS) {
+				fprintf(stderr, "--channels must be between 1 and %d\n", MAX_CHANNELS);
+				exit(1);
+			}
+		} else if (strcmp(argv[i], "--tones")==0 && i + 1 < argc) {
+			tone_lanes = atoi(argv[++i]);
+			if (tone_lanes < 1 || tone_lanes > MAX_LANES) {
+				fprintf(stderr, "--tones must be between 1 and %d\n", MAX_LANES);
+				exit(1);
+			}
+		} else if (strcmp(argv[i], "--tonemap")==0 && i + 1 < argc) {
+			tonemap_path = argv[++i];
+		} else if (strcmp(argv[i], "--cache")==0 && i + 1 < argc) {
+			cache_dir = argv[++i];
+		} else if (strcmp(argv[i], "--no-cache")==0) {
+			cache_dir = NULL;
+		} else if (strcmp(argv[i], "--feedback")==0) {
+			feedback_mode = 1;
+		} else if (strcmp(argv[i], "--control")==0 && i + 1 < argc) {
+			control_path = argv[++i];
+		} else if (strcmp(argv[i], "--stats")==0 && i + 1 < argc) {
+			stats_path = argv[++i];
+		} else if (strcmp(argv[i], "--stats-period")==0 && i + 1 < argc) {
+			stats_period = atoi(argv[++i]);
+			if (stats_period < 1) {
+				fprintf(stderr, "--stats-period must be at least 1 ms\n");
+				exit(1);
+			}
+		} else {
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			exit(1);
+		}
+	}
+	// Only the FFT estimator can pull several tones out of one hop
+	if (tone_lanes > 1 && detector_method != Fft) {
+		printf("--tones %d: using the fft detector\n", tone_lanes);
+		detector_method = Fft;
+	}
 }
 
 // Main
@@ -250,14 +354,13 @@ int main(int argc, char * argv[]) {
 	// TODO: Allow a minimum of <image path> to be provided and default
 	// 	 the rest.
 	if (argc < 8) {
-		fprintf(stderr, "usage: sonify <client name> <image path> <freq scale> <lowest freq> <sin | sq | tri | saw> <window scale>\ni.e. sonify sfy img.png 10000 1000 1 sin\n");
+		fprintf(stderr, "usage: sonify <client name> <image path> <freq scale> <lowest freq> <ms time> <sin | sq | tri | saw> <window scale> [--detector <fcomb | fft>] [--tones <n>] [--channels <n>] [--fps <n>] [--tonemap <file>] [--cache <dir> | --no-cache] [--feedback] [--control <fifo>] [--stats <file | -> [--stats-period <ms>]]\ni.e. sonify sfy img.png 10000 1000 1 sin\n");
 		exit(1);
 	}
 	jack_client_t * client;
 	const char ** ports;
 	char file_name[100];
-	int window_scale;
-	init_vars(argv, file_name, &window_scale);
+	init_vars(argc, argv, file_name, &window_scale);
 
 	// Init Jack Client
 	if ((client = jack_client_open(argv[1], JackNullOption, NULL)) == 0) {
@@ -266,30 +369,66 @@ int main(int argc, char * argv[]) {
 	}
 	jack_set_process_callback(client, process, 0);
 	jack_set_sample_rate_callback(client, srate, 0);
-	input_port = jack_port_register(client, "input", JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
-	output_port = jack_port_register(client, "output", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+	jack_set_xrun_callback(client, xrun, 0);
+	register_ports(client);
 
-	// Get Sample Rate & Init Aubio
 	sample_rate = jack_get_sample_rate(client);
-	init_aubio(sample_rate);
-	
+
+	//   Generate Tones From Pixels
+	// Without a usable cache we still run, just from scratch every time.
+	// Unless the map is cached, the rest of it is built while we play,
+	// except in feedback mode, which plays a writable copy of all of it.
+	cache_init(cache_dir);
+	shown_image = (image_t *) malloc(sizeof(image_t));
+	if (shown_image == NULL) {
+		fprintf(stderr,"memory allocation failed\n");
+		exit(3);
+	}
+	if (image_open(shown_image, file_name, tonemap_path, 0, feedback_mode ? channels : 0) != 0) {
+		exit(1);
+	}
+	// One stripe of rows per channel, in whole groups of lanes so every
+	// group starts in lane 0
+	image_tones_size = tone_table_init(&tone_table, &shown_image->map, channels, tone_lanes, pitch_scale, lower_bounds);
+	if (image_tones_size == 0) {
+		fprintf(stderr, "image too small for %d channels\n", channels);
+		exit(1);
+	}
+	stripe_pixels = image_tones_size / channels;
+
 	// Init SDL Surfaces
-	source_image = IMG_Load(file_name);
-	if (source_image == NULL) {
-		fprintf(stderr, "Load failes: %s\n", IMG_GetError());
+	create_surface();
+
+	// Build Tones | Wavetables, so that process() never has to allocate or
+	// call into libm (see wavebank.h), the pixel clock and the detector
+	settings_t settings = { pitch_scale, lower_bounds, ms_time, waveform_type, detector_method };
+	patch_t * patch = (patch_t *) malloc(sizeof(patch_t));
+	if (patch == NULL) {
+		fprintf(stderr,"memory allocation failed\n");
+		exit(3);
+	}
+	if (patch_build(patch, &settings, shown_image, channels, tone_lanes, sample_rate) != 0) {
 		exit(1);
 	}
-	//   Generate Tones From Pixels
-	generate_tone_array(source_image);
-	dest_image = SDL_CreateRGBSurface (SDL_SWSURFACE, source_image->w, source_image->h, 32, 0, 0, 0, 0);
-	if(dest_image == NULL) {
-		fprintf(stderr, "CreateRGBSurface failed: %s\n", SDL_GetError());
+	printf("render kernels: %s\n", render_init());
+	printf("resize kernels: %s\n", SDL_ResizeKernels(0));
+
+	// Init Analysis, with room for any hop --control may switch to
+	hopclock_t longest;
+	hopclock_init(&longest, sample_rate, ms_time > MAX_HOP_MS ? ms_time : MAX_HOP_MS);
+	if (analysis_start(sample_rate, hopclock_frames(&patch->clock), hopclock_frames(&longest), tone_lanes, channels) != 0) {
+		fprintf(stderr, "cannot start analysis worker\n");
+		return 1;
+	}
+	engine_init(&engine, patch);
+	if (control_start(&engine, sample_rate, hopclock_frames(&longest), control_path) != 0) {
 		exit(1);
-    	}
-	SDL_FreeSurface(source_image);
+	}
 
-	// Build Tone
-	build_tone(image_tones[image_tones_index], image_tones_amp[image_tones_index], waveform_type);
+	// Export stats from here on
+	if (stats_path != NULL && stats_start(stats_path, stats_period) != 0) {
+		exit(1);
+	}
 
 	// Activate Jack Client
 	if (jack_activate(client)) {
@@ -302,47 +441,62 @@ int main(int argc, char * argv[]) {
 		fprintf(stderr, "Init failed: %s\n", SDL_GetError());
 		exit(1);
 	}
-	SDL_Surface * display;
-	display = SDL_SetVideoMode(dest_image->w * window_scale, dest_image->h * window_scale, 32, SDL_HWSURFACE | SDL_DOUBLEBUF);
+	display = SDL_SetVideoMode(dest_image->w * window_scale, dest_image->h * window_scale, 32, SDL_SWSURFACE);
 	if (display == NULL) { 
 		fprintf(stderr, "SetVideoMode failed: %s\n", SDL_GetError()); 
 		exit(1);
 	}
 	SDL_WM_SetCaption("Sonify", "Sonify");
 	SDL_Event event;
+	const char * command;
+	image_t * next;
 
-	// GUI Loop
+	// GUI Loop | Once per frame, rescale only the rows the decoder has
+	// touched, then sleep until the next frame is due
 	// TODO: Implement a fullscreen mode that can be toggled with a keypress.
-	// TODO: The larger the window_scale, the slower SDL_ResizeFactor runs.
-	//       Consider writing a function that only redraws a particular portion
-	//       of dub_image instead. This will improve performance in fullscreen
-	//       mode down the line. 
-	// TODO: Can we introduce some simple menu items for changing the transcoding
-	//       algorithm on the fly?
-	while(1) {
-		if (SDL_PollEvent(&event)) {
+	// Keys change settings on the fly; see key_command()
+	int quit = 0;
+	Uint32 frame_ms = 1000 / fps, next_frame = SDL_GetTicks(), now;
+	while (!quit) {
+		while (SDL_PollEvent(&event)) {
 			if (event.type == SDL_QUIT) {
-				break;
+				quit = 1;
+			} else if (event.type == SDL_KEYDOWN && (command = key_command(event.key.keysym.sym)) != NULL) {
+				control_send(command);
 			}
 		}
-		// TODO: Optimize this...
-		dub_image = SDL_DisplayFormat(dest_image);
-		if (SDL_BlitSurface(SDL_ResizeFactor(dub_image, window_scale, 1), NULL, display, NULL) != 0) {
-			fprintf(stderr, "SDL_BlitSurface() Failed.");
-			exit(1);
+		page_ahead();
+		// Only this thread writes to dest_image
+		while ((next = draw_pixels(dest_image)) != NULL) {
+			show_image(next);
+		}
+		redraw_dirty(display, dest_image);
+		next_frame += frame_ms;
+		now = SDL_GetTicks();
+		if ((Sint32) (next_frame - now) > 0) {
+			SDL_Delay(next_frame - now);
+		} else {
+			// Running late; do not try to catch up
+			next_frame = now;
 		}
-		SDL_Flip(display);
 	}
 
 	// Cleanup
 	jack_client_close(client);
-	del_aubio_pitchdetection(aubio);
-	SDL_FreeSurface(display);
-	SDL_FreeSurface(dub_image);
+	analysis_stop();
+	control_stop();
+	stats_stop();
+	if (stats_get(StatDroppedHops) > 0) {
+		printf("%llu hops dropped while the analysis worker was behind\n", (unsigned long long) stats_get(StatDroppedHops));
+	}
+	if (stats_get(StatToneUnderruns) > 0) {
+		printf("%llu hops held a tone while the image was still loading\n", (unsigned long long) stats_get(StatToneUnderruns));
+	}
+	if (stats_get(StatXruns) > 0) {
+		printf("%llu xruns\n", (unsigned long long) stats_get(StatXruns));
+	}
+	free(dirty_rows);
 	SDL_FreeSurface(dest_image);
 	SDL_Quit();
-	free(cycle);
-	free(image_tones);
-	free(image_tones_amp);
 	exit(0);
 }
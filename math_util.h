@@ -1,5 +1,5 @@
 // math_util.h
-float min(float a, float b, float c) {
+static inline float min(float a, float b, float c) {
 	if (a < b && a < c) {
 		return a;
 	} else if (b < a && b < c) {
@@ -11,7 +11,7 @@ float min(float a, float b, float c) {
 	}
 }
 
-float max(float a, float b, float c) {
+static inline float max(float a, float b, float c) {
 	if (a > b && a > c) {
 		return a;
 	} else if (b > a && b > c) {
@@ -31,7 +31,7 @@ float max(float a, float b, float c) {
 	}
 }
 
-double sgn(double a) {
+static inline double sgn(double a) {
 	if (a > 0)
         	return 1;
 	else if (a < 0)
@@ -0,0 +1,56 @@
+// patch.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <stdio.h>
+#include "patch.h"
+
+int patch_build(patch_t * p, const settings_t * settings, image_t * image, int channels, int lanes,
+		unsigned int sample_rate) {
+	p->settings = *settings;
+	p->image = image;
+	if (tone_table_init(&p->table, &image->map, channels, lanes, settings->pitch_scale, settings->lower_bounds) == 0) {
+		fprintf(stderr, "image too small for %d channels\n", channels);
+		return -1;
+	}
+	p->table.feedback = image_feedback(image);
+	// feedback_write() leaves each row to one channel
+	if (p->table.feedback != NULL && p->table.stripe % image->map.width != 0) {
+		fprintf(stderr, "feedback needs stripes of whole rows\n");
+		return -1;
+	}
+	if (hopclock_init(&p->clock, sample_rate, settings->ms_time) != 0) {
+		fprintf(stderr, "ms time must be more than 0\n");
+		return -1;
+	}
+	if (wavebank_build(&p->bank, sample_rate, settings->waveform_type) != 0) {
+		fprintf(stderr,"memory allocation failed\n");
+		return -1;
+	}
+	if (detector_init(&p->detector, settings->method, sample_rate, hopclock_frames(&p->clock),
+			settings->lower_bounds, settings->pitch_scale) != 0) {
+		fprintf(stderr, "cannot create pitch detector\n");
+		wavebank_free(&p->bank);
+		return -1;
+	}
+	return 0;
+}
+
+void patch_free(patch_t * p) {
+	detector_free(&p->detector);
+	wavebank_free(&p->bank);
+}
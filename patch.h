@@ -0,0 +1,60 @@
+// patch.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// Everything that follows from the image and the settings that may change
+// while sonify plays: the tone table, the wavetables, the pixel clock and
+// the pitch detector. A patch is built whole off the audio thread
+// (control.h) and swapped into engine_process() in one go; each captured
+// hop points back at the patch it was played with, so the analysis worker
+// hears it with the detector that matches.
+#ifndef PATCH_H
+#define PATCH_H
+
+#include "sonify.h"
+#include "tones.h"
+#include "image.h"
+#include "wavebank.h"
+#include "hopclock.h"
+#include "detector.h"
+
+typedef struct {
+	int pitch_scale, lower_bounds;
+	double ms_time;
+	enum TYPE waveform_type;
+	enum METHOD method;
+} settings_t;
+
+typedef struct patch {
+	settings_t settings;
+	image_t * image;		// played by `table`; not owned
+	tone_table_t table;
+	wavebank_t bank;
+	hopclock_t clock;
+	detector_t detector;		// the analysis worker's only
+} patch_t;
+
+// Build everything `settings` needs to play `image` at `sample_rate`,
+// with `channels` and `lanes` as in tone_table_init(). Allocates and plans
+// FFTs, so never call it from process(), and create patches from one
+// thread at a time (see detector_init()). Returns 0 on success, -1 after
+// printing why not.
+int patch_build(patch_t * p, const settings_t * settings, image_t * image, int channels, int lanes,
+		unsigned int sample_rate);
+void patch_free(patch_t * p);
+
+#endif
@@ -0,0 +1,121 @@
+// pitchbench.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// sonify-pitchbench: compare the accuracy and per-hop cost of the pitch
+// detectors on tones from our own oscillator, at 1 ms and 10 ms hops.
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+// 
+#include "sonify.h"
+#include "wavebank.h"
+#include "detector.h"
+
+#define HOPS 2000
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+int main(int argc, char * argv[]) {
+	int pitch_scale = argc > 1 ? atoi(argv[1]) : 10000;
+	int lower_bounds = argc > 2 ? atoi(argv[2]) : 1000;
+	unsigned int sample_rate = argc > 3 ? atoi(argv[3]) : 44100;
+	// The last row runs the FFT estimator FFTPITCH_BATCH hops at a time
+	const char * methods[] = { "fcomb", "fft", "fft" };
+	const char * labels[] = { "fcomb", "fft", "fft/b" };
+	const char * types[] = { "sin", "sq", "tri", "saw" };
+	const int ms_times[] = { 1, 10 };
+	int m, t, h, i;
+
+	printf("range [%d, %d] Hz at %u Hz, %d hops each\n", lower_bounds, lower_bounds + pitch_scale, sample_rate, HOPS);
+	printf("%-6s %-4s %5s %12s %12s %12s %10s\n", "method", "wave", "ms", "mean err Hz", "p99 err Hz", "hue err %", "us/hop");
+	for (h = 0; h < 2; h++) {
+		unsigned int hop_frames = sample_rate * 0.001 * ms_times[h];
+		sample_t * hops = (sample_t *) malloc((size_t) HOPS * hop_frames * sizeof(sample_t));
+		float * truth = (float *) malloc(HOPS * sizeof(float));
+		float * freqs = (float *) malloc(HOPS * sizeof(float));
+		float * err = (float *) malloc(HOPS * sizeof(float));
+		if (hops == NULL || truth == NULL || freqs == NULL || err == NULL) {
+			fprintf(stderr,"memory allocation failed\n");
+			exit(3);
+		}
+		for (t = 0; t < 4; t++) {
+			// Random pixels, played back to back as sonify would
+			wavebank_t bank;
+			osc_t osc;
+			unsigned int j;
+			if (wavebank_build(&bank, sample_rate, (enum TYPE) t) != 0) {
+				fprintf(stderr,"memory allocation failed\n");
+				exit(3);
+			}
+			srand(1);
+			osc.phase = 0;
+			for (i = 0; i < HOPS; i++) {
+				truth[i] = lower_bounds + pitch_scale * (rand() / (float) RAND_MAX);
+				osc.tone = wavebank_tone(&bank, truth[i], 0.5 + 0.5 * (rand() / (float) RAND_MAX));
+				for (j = 0; j < hop_frames; j++) {
+					hops[(size_t) i * hop_frames + j] = osc_tick(&osc);
+				}
+			}
+			wavebank_free(&bank);
+
+			for (m = 0; m < 3; m++) {
+				detector_t d;
+				double start, elapsed, sum = 0;
+				float p99;
+				if (detector_init(&d, parse_method(methods[m]), sample_rate, hop_frames, lower_bounds, pitch_scale) != 0) {
+					fprintf(stderr, "cannot create pitch detector\n");
+					exit(1);
+				}
+				start = now();
+				if (m == 2) {
+					detector_pitch_batch(&d, hops, HOPS, freqs);
+				} else {
+					for (i = 0; i < HOPS; i++) {
+						freqs[i] = detector_pitch(&d, hops + (size_t) i * hop_frames);
+					}
+				}
+				elapsed = now() - start;
+				detector_free(&d);
+				// Error stats; a partial insertion sort is plenty for p99
+				for (i = 0; i < HOPS; i++) {
+					int k = i;
+					float e = fabsf(freqs[i] - truth[i]);
+					sum += e;
+					while (k > 0 && err[k - 1] > e) {
+						err[k] = err[k - 1];
+						k--;
+					}
+					err[k] = e;
+				}
+				p99 = err[HOPS * 99 / 100];
+				printf("%-6s %-4s %5d %12.2f %12.2f %12.3f %10.2f\n", labels[m], types[t], ms_times[h],
+						sum / HOPS, p99, 100 * sum / HOPS / pitch_scale, elapsed * 1e6 / HOPS);
+			}
+		}
+		free(hops);
+		free(truth);
+		free(freqs);
+		free(err);
+	}
+	exit(0);
+}
@@ -0,0 +1,178 @@
+// render.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <math.h>
+#include "render.h"
+
+// Frames of scratch space render_tones() mixes through
+#define RENDER_SCRATCH 256
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RENDER_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+// Plain C | Always available
+static void render_tone_c(osc_t * osc, sample_t * out, unsigned int n) {
+	unsigned int i;
+	for (i = 0; i < n; i++) {
+		out[i] = osc_tick(osc);
+	}
+}
+
+static sample_t render_peak_c(const sample_t * in, unsigned int n, sample_t peak) {
+	unsigned int i;
+	for (i = 0; i < n; i++) {
+		if (fabsf(in[i]) > peak) {
+			peak = fabsf(in[i]);
+		}
+	}
+	return peak;
+}
+
+#ifdef RENDER_X86
+// SSE2 | Four frames at a time. There is no gather, so table reads are
+// scalar, but phase, index and interpolation math are vectorized.
+__attribute__((target("sse2")))
+static void render_tone_sse2(osc_t * osc, sample_t * out, unsigned int n) {
+	const sample_t * t = osc->tone.table;
+	uint32_t step = osc->tone.step;
+	__m128i phase = _mm_setr_epi32(osc->phase, osc->phase + step, osc->phase + 2 * step, osc->phase + 3 * step);
+	__m128i step4 = _mm_set1_epi32(step * 4);
+	__m128i mask = _mm_set1_epi32((1u << WAVEBANK_FRAC_BITS) - 1);
+	__m128 scale = _mm_set1_ps(1.0f / (1u << WAVEBANK_FRAC_BITS));
+	__m128 gain = _mm_set1_ps(osc->tone.gain);
+	unsigned int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		uint32_t idx[4] __attribute__((aligned(16)));
+		__m128 a, b, frac;
+		_mm_store_si128((__m128i *) idx, _mm_srli_epi32(phase, WAVEBANK_FRAC_BITS));
+		a = _mm_set_ps(t[idx[3]], t[idx[2]], t[idx[1]], t[idx[0]]);
+		b = _mm_set_ps(t[idx[3] + 1], t[idx[2] + 1], t[idx[1] + 1], t[idx[0] + 1]);
+		frac = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(phase, mask)), scale);
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(a, _mm_mul_ps(frac, _mm_sub_ps(b, a))), gain));
+		phase = _mm_add_epi32(phase, step4);
+	}
+	osc->phase += step * i;
+	render_tone_c(osc, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static sample_t render_peak_sse2(const sample_t * in, unsigned int n, sample_t peak) {
+	__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 m = _mm_set1_ps(peak);
+	float lanes[4];
+	unsigned int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		m = _mm_max_ps(m, _mm_and_ps(_mm_loadu_ps(in + i), abs_mask));
+	}
+	_mm_storeu_ps(lanes, m);
+	peak = lanes[0];
+	for (n -= i, in += i, i = 1; i < 4; i++) {
+		if (lanes[i] > peak) {
+			peak = lanes[i];
+		}
+	}
+	return render_peak_c(in, n, peak);
+}
+
+// AVX2 | Eight frames at a time, with gathered table reads
+__attribute__((target("avx2")))
+static void render_tone_avx2(osc_t * osc, sample_t * out, unsigned int n) {
+	const sample_t * t = osc->tone.table;
+	uint32_t step = osc->tone.step;
+	__m256i phase = _mm256_add_epi32(_mm256_set1_epi32(osc->phase),
+			_mm256_mullo_epi32(_mm256_set1_epi32(step), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+	__m256i step8 = _mm256_set1_epi32(step * 8);
+	__m256i mask = _mm256_set1_epi32((1u << WAVEBANK_FRAC_BITS) - 1);
+	__m256 scale = _mm256_set1_ps(1.0f / (1u << WAVEBANK_FRAC_BITS));
+	__m256 gain = _mm256_set1_ps(osc->tone.gain);
+	unsigned int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i idx = _mm256_srli_epi32(phase, WAVEBANK_FRAC_BITS);
+		__m256 a = _mm256_i32gather_ps(t, idx, 4);
+		__m256 b = _mm256_i32gather_ps(t + 1, idx, 4);
+		__m256 frac = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(phase, mask)), scale);
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_add_ps(a, _mm256_mul_ps(frac, _mm256_sub_ps(b, a))), gain));
+		phase = _mm256_add_epi32(phase, step8);
+	}
+	osc->phase += step * i;
+	render_tone_c(osc, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static sample_t render_peak_avx2(const sample_t * in, unsigned int n, sample_t peak) {
+	__m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 m = _mm256_set1_ps(peak);
+	float lanes[8];
+	unsigned int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		m = _mm256_max_ps(m, _mm256_and_ps(_mm256_loadu_ps(in + i), abs_mask));
+	}
+	_mm256_storeu_ps(lanes, m);
+	peak = lanes[0];
+	for (n -= i, in += i, i = 1; i < 8; i++) {
+		if (lanes[i] > peak) {
+			peak = lanes[i];
+		}
+	}
+	return render_peak_c(in, n, peak);
+}
+#endif
+
+void (*render_tone)(osc_t * osc, sample_t * out, unsigned int n) = render_tone_c;
+sample_t (*render_peak)(const sample_t * in, unsigned int n, sample_t peak) = render_peak_c;
+
+void render_tones(osc_t * osc, unsigned int count, sample_t * out, unsigned int n) {
+	sample_t scratch[RENDER_SCRATCH];
+	unsigned int done, span, k, i;
+	if (count == 1) {
+		render_tone(osc, out, n);
+		return;
+	}
+	for (done = 0; done < n; done += span) {
+		span = n - done < RENDER_SCRATCH ? n - done : RENDER_SCRATCH;
+		render_tone(&osc[0], out + done, span);
+		for (k = 1; k < count; k++) {
+			render_tone(&osc[k], scratch, span);
+			for (i = 0; i < span; i++) {
+				out[done + i] += scratch[i];
+			}
+		}
+	}
+}
+
+const char * render_init() {
+#ifdef RENDER_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		render_tone = render_tone_avx2;
+		render_peak = render_peak_avx2;
+		return "avx2";
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		render_tone = render_tone_sse2;
+		render_peak = render_peak_sse2;
+		return "sse2";
+	}
+#endif
+	render_tone = render_tone_c;
+	render_peak = render_peak_c;
+	return "c";
+}
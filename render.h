@@ -0,0 +1,39 @@
+// render.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// Block kernels for process(): render a span of one tone and track the
+// peak of a span of input. render_init() picks AVX2, SSE2 or plain C
+// versions for the CPU we are running on.
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "sonify.h"
+#include "wavebank.h"
+
+// Fill `out` with `n` samples of `osc`, advancing its phase
+extern void (*render_tone)(osc_t * osc, sample_t * out, unsigned int n);
+// Return the larger of `peak` and the largest magnitude in `in`
+extern sample_t (*render_peak)(const sample_t * in, unsigned int n, sample_t peak);
+
+// Fill `out` with the sum of `count` oscillators
+void render_tones(osc_t * osc, unsigned int count, sample_t * out, unsigned int n);
+
+// Select kernels; returns the name of the set chosen
+const char * render_init();
+
+#endif
@@ -16,10 +16,12 @@
 
 	Summary:
 
-		- Horizontal filter contributions are calculated on the fly,
-		  as each column is mapped from src to dst image. This lets 
-		  us omit having to allocate a temporary full horizontal stretch 
-		  of the src image.
+		- Filter contributions for each axis are calculated once per
+		  (src size, dst size, filter) and cached, since we resize the
+		  same surfaces every frame. Rows are stretched horizontally
+		  into a temporary buffer and then blended vertically, row-major,
+		  on packed 32-bit pixels; bands of dst rows go to separate
+		  threads.
 
 		- If none of the src pixels within a sampling region differ, 
 		  then the output pixel is forced to equal (any of) the source pixel.
@@ -48,6 +50,9 @@
 
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <SDL.h>
 
 /* clamp the input to the specified range */
@@ -55,6 +60,29 @@
 #ifndef M_PI
 #define M_PI    3.14159265359
 #endif
+/* contribution tables kept around, keyed by (src size, dst size, filter) */
+#define FILTER_CACHE_SIZE 4
+/* fewest dst rows worth starting a thread for */
+#define FILTER_ROWS_PER_THREAD 32
+#define FILTER_MAX_THREADS 16
+/* weights in the fixed-point kernels are Q14 */
+#define FILTER_SHIFT 14
+#define FILTER_ONE (1 << FILTER_SHIFT)
+/* fraction bits kept in rows between the horizontal and vertical passes,
+   so that only the final result is rounded to 8 bits */
+#define FILTER_TMP_SHIFT 7
+#define FILTER_TMP_HALF (1 << (FILTER_TMP_SHIFT - 1))
+#define FILTER_TMP_MAX (255 << FILTER_TMP_SHIFT)
+#define FILTER_TMP_ROUND(v) (((v) + FILTER_TMP_HALF) >> FILTER_TMP_SHIFT)
+#define FILTER_X_SHIFT (FILTER_SHIFT - FILTER_TMP_SHIFT)
+#define FILTER_X_HALF (1 << (FILTER_X_SHIFT - 1))
+#define FILTER_Y_SHIFT (FILTER_SHIFT + FILTER_TMP_SHIFT)
+#define FILTER_Y_HALF (1 << (FILTER_Y_SHIFT - 1))
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FILTER_X86 1
+#include <immintrin.h>
+#endif
 
 typedef	Uint8 Pixel;
 typedef struct
@@ -77,8 +105,12 @@ typedef struct
 
 SDL_Surface* SDL_ResizeFactor(SDL_Surface *image, float scalefactor,    int filter);
 SDL_Surface* SDL_ResizeXY(SDL_Surface *image, int new_w, int new_h, int filter);
+int SDL_ResizeRowsInto(SDL_Surface *src, SDL_Surface *dst, int y0, int y1, int filter, SDL_Rect *changed);
+const char* SDL_ResizeKernels(int reference);
 
 static SDL_Surface *filter_resizexy(SDL_Surface* source,int new_w, int new_h, int filter);
+static void filter_select(int filter, double (**f)(double), double *s);
+static int filter_zoom2(SDL_Surface *dst, SDL_Surface *src, double (*filterf)(double), double fwidth, int dy0, int dy1);
 
 static Uint32 filter_GetPixel(SDL_Surface *surface, int x, int y)
 {
@@ -202,42 +234,6 @@ SDL_Surface* SDL_ResizeXY(SDL_Surface *image, int new_w, int new_h, int filter)
     return image;
 }
 
-static Pixel filter_get_pixel2(SDL_Surface *image, int x, int y, int which)
-{	
-    static Uint8 r=0, g=0, b=0, a=0;	
-    static int xx=-1, yy=-1;
-    Pixel p = 0;
-
-    if((x < 0) || (x >= image->w) || (y < 0) || (y >= image->h))
-        return(0);
-
-    if ((xx!=x) || (yy!=y))
-    {
-        Uint32 fullpixel;
-        xx = x; yy = y; //this way it only calls the Getpixel,RGBA once per pixel...
-        fullpixel = filter_GetPixel(image,x,y);
-        SDL_GetRGBA(fullpixel,image->format,&r,&g,&b,&a);
-    }
-
-    switch (which)
-    {
-        case 0 : p = r; break;
-        case 1 : p = g; break;
-        case 2 : p = b; break;
-        case 3 : p = a; break;
-        default: p = r; break; //not really needed...
-    }	
-    return(p);
-}
-
-static char filter_put_pixel2(SDL_Surface *image, int x, int y, Uint8 c[4])
-{	
-    if((x < 0) || (x >= image->w) || (y < 0) || (y >= image->h))    
-        return 0;
-    filter_PutPixel(image,x,y,SDL_MapRGBA(image->format,c[0],c[1],c[2],c[3]));
-    return 1;
-}
-
 static double filter_hermite_interp(double t)
 {
 	/* f(t) = 2|t|^3 - 3|t|^2 + 1, -1 <= t <= 1 */
@@ -350,253 +346,888 @@ static int filter_roundcloser(double d)
 	return n;
 } /* filter_roundcloser */
 
-static int filter_calc_x_contrib(CLIST *contribX, double xscale, double fwidth, 
-					int dstwidth, int srcwidth, double (*filterf)(double), int i)
+/* Contribution tables for one axis: one CLIST per dst pixel, their
+   contributions back to back in pool. The fixed-point kernels use index
+   and fixed instead: exactly taps per dst pixel (an even number), padded
+   out with the first contributor at zero weight. */
+typedef struct
+{
+	int	srclen, dstlen;
+	double	(*filterf)(double);
+	CLIST	*list;
+	CONTRIB	*pool;
+	int	taps;
+	int	*index;
+	Sint16	*fixed;		/* Q14 */
+	int	refs;		/* the cache's, and each zoom's using it */
+} filter_Table;
+
+static filter_Table *filter_cache[FILTER_CACHE_SIZE];
+static int filter_cache_next = 0;
+static pthread_mutex_t filter_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* One band of dst rows, for one thread */
+typedef struct
 {
-	double width;
-	double fscale;
+	SDL_Surface	*dst, *src;
+	const filter_Table *X, *Y;
+	int	dy0, dy1;
+	int	nRet;
+} filter_Job;
+
+/* Worker threads, started on first use and kept for good. A zoom posts
+   its bands in jobs; every worker, and the zooming thread too, takes the
+   next band until none are left. One zoom at a time has the pool (busy);
+   any other runs its bands itself. */
+static struct
+{
+	pthread_mutex_t lock;
+	pthread_cond_t work, done;
+	pthread_mutex_t busy;
+	filter_Job *jobs;
+	int	count, next, left;
+} filter_pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+	PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, 0 };
+static pthread_once_t filter_pool_once = PTHREAD_ONCE_INIT;
+
+static int filter_build_table(filter_Table *t, int srclen, int dstlen, 
+					double (*filterf)(double), double fwidth)
+{
+	double scale = (double) dstlen / (double) srclen;
+	double width, fscale;
 	double center, left, right;
 	double weight;
-	int j, k, n;
+	int i, j, k, n, most, taps;
 
-	if(xscale < 1.0)
+	if(scale < 1.0)
 	{
 		/* Shrinking image */
-		width = fwidth / xscale;
-		fscale = 1.0 / xscale;
-
-		contribX->n = 0;
-		contribX->p = (CONTRIB *)calloc((int) (width * 2 + 1),
-				sizeof(CONTRIB));
-		if(contribX->p == NULL)
-			return -1;
+		width = fwidth / scale;
+		fscale = 1.0 / scale;
+	}
+	else
+	{
+		/* Expanding image */
+		width = fwidth;
+		fscale = 1.0;
+	}
+	most = (int) (width * 2 + 1);
+	taps = (most + 1) & ~1;
+
+	t->list = (CLIST *)calloc(dstlen, sizeof(CLIST));
+	t->pool = (CONTRIB *)calloc((size_t) dstlen * most, sizeof(CONTRIB));
+	t->index = (int *)calloc((size_t) dstlen * taps, sizeof(int));
+	t->fixed = (Sint16 *)calloc((size_t) dstlen * taps, sizeof(Sint16));
+	if(t->list == NULL || t->pool == NULL || t->index == NULL || t->fixed == NULL)
+	{
+		free(t->list);
+		free(t->pool);
+		free(t->index);
+		free(t->fixed);
+		t->list = NULL;
+		t->pool = NULL;
+		t->index = NULL;
+		t->fixed = NULL;
+		return -1;
+	}
 
-		center = (double) i / xscale;
+	for(i = 0; i < dstlen; ++i)
+	{
+		t->list[i].n = 0;
+		t->list[i].p = t->pool + (size_t) i * most;
+		center = (double) i / scale;
 		left = ceil(center - width);
 		right = floor(center + width);
 		for(j = (int)left; j <= right; ++j)
 		{
 			weight = center - (double) j;
-			weight = ((*filterf)(weight / fscale)) / fscale;
+			weight = (*filterf)(weight / fscale) / fscale;
 			if(j < 0)
 				n = -j;
-			else if(j >= srcwidth)
-				n = (srcwidth - j) + srcwidth - 1;
+			else if(j >= srclen)
+				n = (srclen - j) + srclen - 1;
 			else
 				n = j;
-			
-			k = contribX->n++;
-			contribX->p[k].pixel = n;
-			contribX->p[k].weight = weight;
+			/* tiny images can mirror right off the other side */
+			n = CLAMP(n, 0, srclen - 1);
+
+			k = t->list[i].n++;
+			t->list[i].p[k].pixel = n;
+			t->list[i].p[k].weight = weight;
 		}
-	
-	}
-	else
-	{
-		/* Expanding image */
-		contribX->n = 0;
-		contribX->p = (CONTRIB *)calloc((int) (fwidth * 2 + 1),
-				sizeof(CONTRIB));
-		if(contribX->p == NULL)
-			return -1;
-		center = (double) i / xscale;
-		left = ceil(center - fwidth);
-		right = floor(center + fwidth);
 
-		for(j = (int)left; j <= right; ++j)
+		/* Q14, padded to `taps` */
+		for(k = 0; k < taps; ++k)
 		{
-			weight = center - (double) j;
-			weight = (*filterf)(weight);
-			if(j < 0) {
-				n = -j;
-			} else if(j >= srcwidth) {
-				n = (srcwidth - j) + srcwidth - 1;
-			} else {
-				n = j;
+			int *index = t->index + (size_t) i * taps;
+			Sint16 *fixed = t->fixed + (size_t) i * taps;
+			if(k < t->list[i].n)
+			{
+				index[k] = t->list[i].p[k].pixel;
+				fixed[k] = (Sint16) CLAMP(filter_roundcloser(t->list[i].p[k].weight * FILTER_ONE), -32768, 32767);
+			}
+			else
+			{
+				index[k] = t->list[i].n > 0 ? t->list[i].p[0].pixel : 0;
+				fixed[k] = 0;
 			}
-			k = contribX->n++;
-			contribX->p[k].pixel = n;
-			contribX->p[k].weight = weight;
 		}
 	}
+	t->taps = taps;
+	t->srclen = srclen;
+	t->dstlen = dstlen;
+	t->filterf = filterf;
 	return 0;
-} /* filter_calc_x_contrib */
-
-static int filter_zoom2(SDL_Surface *dst, SDL_Surface *src, double (*filterf)(double), double fwidth)
-{
-	Pixel* tmp;
-	double xscale, yscale;		/* zoom scale factors */
-	int xx;
-	int i, j, k;			/* loop variables */
-	int n;				/* pixel number */
-	double center, left, right;	/* filter calculation variables */
-	double width, fscale, weight;	/* filter calculation variables */
-	Uint8 weightedcolor[4]; //reconstruct the pixel out of these!
-	Pixel pel, pel2;
-	int bPelDelta;
-	CLIST	*contribY;		/* array of contribution lists */
-	CLIST	contribX;
-	int		nRet = -1;
-
-	/* create intermediate column to hold horizontal dst column zoom */
-	tmp = (Pixel*)malloc(src->h * sizeof(Pixel) * 4);
-	if(tmp == NULL)
-		return 0;
+} /* filter_build_table */
 
-	xscale = (double) dst->w / (double) src->w;
+static void filter_release(filter_Table *t)
+{
+	free(t->list);
+	free(t->pool);
+	free(t->index);
+	free(t->fixed);
+	free(t);
+} /* filter_release */
+
+/* Drop a reference to t, freeing it with the last. Call with
+   filter_cache_lock held. */
+static void filter_unref(filter_Table *t)
+{
+	if(--t->refs == 0)
+		filter_release(t);
+} /* filter_unref */
+
+/* Contributions for resampling srclen pixels to dstlen with filterf, from
+   the cache or built and cached now. The caller holds a reference until
+   filter_put(), so the table outlives its eviction from the cache. */
+static const filter_Table *filter_table(int srclen, int dstlen, double (*filterf)(double), double fwidth)
+{
+	filter_Table *t;
+	int i;
 
-	/* Build y weights */
-	/* pre-calculate filter contributions for a column */
-	contribY = (CLIST *)calloc(dst->h, sizeof(CLIST));
-	if(contribY == NULL)
+	pthread_mutex_lock(&filter_cache_lock);
+	for(i = 0; i < FILTER_CACHE_SIZE; ++i)
 	{
-		free(tmp);
-		return -1;
+		t = filter_cache[i];
+		if(t != NULL && t->srclen == srclen && t->dstlen == dstlen && t->filterf == filterf)
+		{
+			t->refs++;
+			pthread_mutex_unlock(&filter_cache_lock);
+			return t;
+		}
+	}
+	pthread_mutex_unlock(&filter_cache_lock);
+
+	/* Build without the lock; two threads may both build one, which is
+	   only wasted work */
+	t = (filter_Table *)calloc(1, sizeof(filter_Table));
+	if(t == NULL)
+		return NULL;
+	if(0 != filter_build_table(t, srclen, dstlen, filterf, fwidth))
+	{
+		free(t);
+		return NULL;
 	}
+	t->refs = 2;
+
+	pthread_mutex_lock(&filter_cache_lock);
+	if(filter_cache[filter_cache_next] != NULL)
+		filter_unref(filter_cache[filter_cache_next]);
+	filter_cache[filter_cache_next] = t;
+	filter_cache_next = (filter_cache_next + 1) % FILTER_CACHE_SIZE;
+	pthread_mutex_unlock(&filter_cache_lock);
+	return t;
+} /* filter_table */
+
+static void filter_put(const filter_Table *t)
+{
+	pthread_mutex_lock(&filter_cache_lock);
+	filter_unref((filter_Table *) t);
+	pthread_mutex_unlock(&filter_cache_lock);
+} /* filter_put */
+
+/* 4 bytes per pixel, 8 bits per channel: we can shift channels in and out
+   of the packed pixel ourselves */
+static int filter_packed(SDL_PixelFormat *fmt)
+{
+	return fmt->BytesPerPixel == 4 && fmt->Rloss == 0 && fmt->Gloss == 0 && fmt->Bloss == 0 &&
+		(fmt->Amask == 0 || fmt->Aloss == 0);
+}
 
-	yscale = (double) dst->h / (double) src->h;
+/* Unpack row y of src to r, g, b, a bytes */
+static void filter_load_row(SDL_Surface *src, int y, Uint8 *out)
+{
+	SDL_PixelFormat *fmt = src->format;
+	int x;
 
-	if(yscale < 1.0)
+	if(filter_packed(fmt))
 	{
-		width = fwidth / yscale;
-		fscale = 1.0 / yscale;
-		for(i = 0; i < dst->h; ++i)
+		const Uint32 *p = (const Uint32 *) ((Uint8 *) src->pixels + y * src->pitch);
+		for(x = 0; x < src->w; x++, out += 4)
 		{
-			contribY[i].n = 0;
-			contribY[i].p = (CONTRIB *)calloc((int) (width * 2 + 1),
-					sizeof(CONTRIB));
-			if(contribY[i].p == NULL)
-			{
-				free(tmp);
-				free(contribY);
-				return -1;
-			}
-			center = (double) i / yscale;
-			left = ceil(center - width);
-			right = floor(center + width);
-			for(j = (int)left; j <= right; ++j) {
-				weight = center - (double) j;
-				weight = (*filterf)(weight / fscale) / fscale;
-				if(j < 0) {
-					n = -j;
-				} else if(j >= src->h) {
-					n = (src->h - j) + src->h - 1;
-				} else {
-					n = j;
-				}
-				k = contribY[i].n++;
-				contribY[i].p[k].pixel = n;
-				contribY[i].p[k].weight = weight;
-			}
-		}
-	} else {
-		for(i = 0; i < dst->h; ++i) {
-			contribY[i].n = 0;
-			contribY[i].p = (CONTRIB *)calloc((int) (fwidth * 2 + 1),
-					sizeof(CONTRIB));
-			if(contribY[i].p == NULL)
-			{
-				free(tmp);
-				free(contribY);
-				return -1;
-			}
-			center = (double) i / yscale;
-			left = ceil(center - fwidth);
-			right = floor(center + fwidth);
-			for(j = (int)left; j <= right; ++j) {
-				weight = center - (double) j;
-				weight = (*filterf)(weight);
-				if(j < 0) {
-					n = -j;
-				} else if(j >= src->h) {
-					n = (src->h - j) + src->h - 1;
-				} else {
-					n = j;
-				}
-				k = contribY[i].n++;
-				contribY[i].p[k].pixel = n;
-				contribY[i].p[k].weight = weight;
-			}
+			out[0] = (p[x] & fmt->Rmask) >> fmt->Rshift;
+			out[1] = (p[x] & fmt->Gmask) >> fmt->Gshift;
+			out[2] = (p[x] & fmt->Bmask) >> fmt->Bshift;
+			out[3] = fmt->Amask ? (p[x] & fmt->Amask) >> fmt->Ashift : SDL_ALPHA_OPAQUE;
 		}
 	}
-	
+	else
+	{
+		for(x = 0; x < src->w; x++, out += 4)
+			SDL_GetRGBA(filter_GetPixel(src, x, y), fmt, &out[0], &out[1], &out[2], &out[3]);
+	}
+} /* filter_load_row */
 
+/* Pack r, g, b, a bytes into row y of dst */
+static void filter_store_row(SDL_Surface *dst, int y, const Uint8 *in)
+{
+	SDL_PixelFormat *fmt = dst->format;
+	int x;
 
-	for(xx = 0; xx < dst->w; xx++)
+	if(filter_packed(fmt))
 	{
-		if(0 != filter_calc_x_contrib(&contribX, xscale, fwidth, 
-								dst->w, src->w, filterf, xx))
+		Uint32 *p = (Uint32 *) ((Uint8 *) dst->pixels + y * dst->pitch);
+		for(x = 0; x < dst->w; x++, in += 4)
 		{
-			goto __zoom_cleanup;
+			p[x] = ((Uint32) in[0] << fmt->Rshift) | ((Uint32) in[1] << fmt->Gshift) |
+				((Uint32) in[2] << fmt->Bshift) | (fmt->Amask ? (Uint32) in[3] << fmt->Ashift : 0);
 		}
-		/* Apply horz filter to make dst column in tmp. */
-		for(k = 0; k < src->h; ++k)
+	}
+	else
+	{
+		for(x = 0; x < dst->w; x++, in += 4)
+			filter_PutPixel(dst, x, y, SDL_MapRGBA(fmt, in[0], in[1], in[2], in[3]));
+	}
+} /* filter_store_row */
+
+/* Double precision | The reference for the fixed-point kernels below.
+   Stretch one unpacked row horizontally, rounded to whole values as the
+   original code did but kept in the same fixed-point rows. */
+static void filter_row_x_double(const Uint8 *in, Uint16 *out, const filter_Table *X)
+{
+	int x, c, j;
+	double weight;
+	Pixel pel, pel2;
+	int bPelDelta;
+
+	for(x = 0; x < X->dstlen; x++, out += 4)
+	{
+		const CLIST *contrib = &X->list[x];
+		for(c = 0; c < 4; c++)
 		{
-		  //mine!!!!
-		  int w=0;
-		  for (; w<4; w++) {
 			weight = 0.0;
 			bPelDelta = 0;
-			pel = filter_get_pixel2(src, contribX.p[0].pixel, k, w);
-			for(j = 0; j < contribX.n; ++j)
+			pel = in[contrib->p[0].pixel * 4 + c];
+			for(j = 0; j < contrib->n; ++j)
 			{
-				pel2 = filter_get_pixel2(src, contribX.p[j].pixel, k, w);
+				pel2 = in[contrib->p[j].pixel * 4 + c];
 				if(pel2 != pel)
 					bPelDelta = 1;
-				weight += pel2 * contribX.p[j].weight;
+				weight += pel2 * contrib->p[j].weight;
 			}
 			weight = bPelDelta ? filter_roundcloser(weight) : pel;
+			out[c] = (Uint16)CLAMP(weight, 0, 255) << FILTER_TMP_SHIFT;
+		}
+	}
+} /* filter_row_x_double */
 
-			tmp[k+w*src->h] = (Pixel)CLAMP(weight, 0, 255); // keep it Uint8
-		  } //cycle through each color...
-		} /* next row in temp column */
+/* Blend the rows of tmp (already stretched horizontally, starting at src
+   row ky0, len values each) that contribute to dst row y. acc and delta
+   are scratch. */
+static void filter_row_y_double(const Uint16 *tmp, int ky0, int len, const filter_Table *Y, int y,
+					double *acc, Uint8 *delta, Uint8 *out)
+{
+	const CLIST *contrib = &Y->list[y];
+	const Uint16 *first = tmp + (size_t) (contrib->p[0].pixel - ky0) * len;
+	int i, j;
 
-		free(contribX.p);
+	for(i = 0; i < len; i++)
+	{
+		acc[i] = 0.0;
+		delta[i] = 0;
+	}
+	for(j = 0; j < contrib->n; ++j)
+	{
+		const Uint16 *row = tmp + (size_t) (contrib->p[j].pixel - ky0) * len;
+		double weight = contrib->p[j].weight;
+		for(i = 0; i < len; i++)
+		{
+			acc[i] += (row[i] >> FILTER_TMP_SHIFT) * weight;
+			delta[i] |= row[i] != first[i];
+		}
+	}
+	for(i = 0; i < len; i++)
+	{
+		double weight = delta[i] ? filter_roundcloser(acc[i]) : first[i] >> FILTER_TMP_SHIFT;
+		out[i] = (Pixel)CLAMP(weight, 0, 255);
+	}
+} /* filter_row_y_double */
 
+/* Fixed point | Q14 weights, int accumulators. Same rules as the double
+   code above: rounded to nearest, clamped, and left alone where every
+   contributor is the same. The horizontal pass keeps FILTER_TMP_SHIFT
+   bits of fraction, so only the vertical pass rounds to 8 bits. */
+static void filter_row_x_c(const Uint8 *in, Uint16 *out, const filter_Table *X)
+{
+	int x, c, j, acc, bPelDelta;
+	Pixel pel, pel2;
 
-		/* The temp column has been built. Now stretch it 
-		 vertically into dst column. */
-		for(i = 0; i < dst->h; ++i)
+	for(x = 0; x < X->dstlen; x++, out += 4)
+	{
+		const int *index = X->index + (size_t) x * X->taps;
+		const Sint16 *fixed = X->fixed + (size_t) x * X->taps;
+		for(c = 0; c < 4; c++)
 		{
-		  int w=0;
-		  for (; w<4; w++) {
-			weight = 0.0;
+			acc = 0;
 			bPelDelta = 0;
-			pel = tmp[contribY[i].p[0].pixel+w*src->h];
-
-			for(j = 0; j < contribY[i].n; ++j)
+			pel = in[index[0] * 4 + c];
+			for(j = 0; j < X->taps; ++j)
 			{
-				pel2 = tmp[contribY[i].p[j].pixel+w*src->h];
-				if(pel2 != pel)
-					bPelDelta = 1;
-				weight += pel2 * contribY[i].p[j].weight;
+				pel2 = in[index[j] * 4 + c];
+				bPelDelta |= pel2 != pel;
+				acc += pel2 * fixed[j];
 			}
-			weight = bPelDelta ? filter_roundcloser(weight) : pel;
-			weightedcolor[w] = (Uint8)CLAMP(weight, 0, 255); //get all 4 "colors" this way
-	      }
-		  filter_put_pixel2(dst, xx, i, weightedcolor ); //keep it Uint8
-		} /* next dst row */
+			acc = (acc + FILTER_X_HALF) >> FILTER_X_SHIFT;
+			out[c] = bPelDelta ? (Uint16)CLAMP(acc, 0, FILTER_TMP_MAX) : pel << FILTER_TMP_SHIFT;
+		}
+	}
+} /* filter_row_x_c */
+
+static void filter_row_y_c(const Uint16 *tmp, int ky0, int len, const filter_Table *Y, int y,
+					double *scratch, Uint8 *delta, Uint8 *out)
+{
+	const int *index = Y->index + (size_t) y * Y->taps;
+	const Sint16 *fixed = Y->fixed + (size_t) y * Y->taps;
+	const Uint16 *first = tmp + (size_t) (index[0] - ky0) * len;
+	int *acc = (int *) scratch;
+	int i, j;
+
+	for(i = 0; i < len; i++)
+	{
+		acc[i] = 0;
+		delta[i] = 0;
+	}
+	for(j = 0; j < Y->taps; ++j)
+	{
+		const Uint16 *row = tmp + (size_t) (index[j] - ky0) * len;
+		int weight = fixed[j];
+		for(i = 0; i < len; i++)
+		{
+			acc[i] += row[i] * weight;
+			delta[i] |= FILTER_TMP_ROUND(row[i]) != FILTER_TMP_ROUND(first[i]);
+		}
+	}
+	for(i = 0; i < len; i++)
+	{
+		int v = (acc[i] + FILTER_Y_HALF) >> FILTER_Y_SHIFT;
+		out[i] = delta[i] ? (Pixel)CLAMP(v, 0, 255) : FILTER_TMP_ROUND(first[i]);
+	}
+} /* filter_row_y_c */
+
+#ifdef FILTER_X86
+/* FILTER_TMP_ROUND() of eight or sixteen values */
+#define FILTER_ROUND_SSE(v) _mm_srli_epi16(_mm_add_epi16((v), tmp_half), FILTER_TMP_SHIFT)
+#define FILTER_ROUND_AVX2(v) _mm256_srli_epi16(_mm256_add_epi16((v), tmp_half), FILTER_TMP_SHIFT)
+
+/* Pair pixel weights j and j + 1 for _mm_madd_epi16 */
+#define FILTER_PAIR(fixed, j) \
+	((int) (((Uint32) (Uint16) (fixed)[(j) + 1] << 16) | (Uint16) (fixed)[j]))
+
+/* SSE4.1 | One dst pixel per vector, all four channels at once. Pairs of
+   contributors are interleaved so one madd applies both weights. */
+__attribute__((target("sse4.1")))
+static inline void filter_pixel_sse41(const Uint8 *in, const int *index, const Sint16 *fixed, int taps, Uint16 *out)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i first, lo, hi, same, acc = zero;
+	Uint32 a32, b32;
+	int j;
+
+	memcpy(&a32, in + index[0] * 4, 4);
+	first = lo = hi = _mm_cvtsi32_si128(a32);
+	for(j = 0; j < taps; j += 2)
+	{
+		__m128i a, b, ab;
+		memcpy(&a32, in + index[j] * 4, 4);
+		memcpy(&b32, in + index[j + 1] * 4, 4);
+		a = _mm_cvtsi32_si128(a32);
+		b = _mm_cvtsi32_si128(b32);
+		lo = _mm_min_epu8(lo, _mm_min_epu8(a, b));
+		hi = _mm_max_epu8(hi, _mm_max_epu8(a, b));
+		ab = _mm_unpacklo_epi8(_mm_unpacklo_epi8(a, b), zero);
+		acc = _mm_add_epi32(acc, _mm_madd_epi16(ab, _mm_set1_epi32(FILTER_PAIR(fixed, j))));
+	}
+	acc = _mm_srai_epi32(_mm_add_epi32(acc, _mm_set1_epi32(FILTER_X_HALF)), FILTER_X_SHIFT);
+	acc = _mm_min_epu16(_mm_packus_epi32(acc, acc), _mm_set1_epi16(FILTER_TMP_MAX));
+	first = _mm_slli_epi16(_mm_unpacklo_epi8(first, zero), FILTER_TMP_SHIFT);
+	same = _mm_cmpeq_epi8(lo, hi);
+	acc = _mm_blendv_epi8(acc, first, _mm_unpacklo_epi8(same, same));
+	_mm_storel_epi64((__m128i *) out, acc);
+} /* filter_pixel_sse41 */
+
+__attribute__((target("sse4.1")))
+static void filter_row_x_sse41(const Uint8 *in, Uint16 *out, const filter_Table *X)
+{
+	int x;
+	for(x = 0; x < X->dstlen; x++, out += 4)
+		filter_pixel_sse41(in, X->index + (size_t) x * X->taps, X->fixed + (size_t) x * X->taps, X->taps, out);
+} /* filter_row_x_sse41 */
+
+/* Values [0, n) of the tmp rows in index, each `stride` values apart;
+   four dst pixels per iteration */
+__attribute__((target("sse4.1")))
+static inline void filter_blend_sse41(const Uint16 *tmp, int ky0, int stride, int n,
+					const int *index, const Sint16 *fixed, int taps, Uint8 *out)
+{
+	const Uint16 *first = tmp + (size_t) (index[0] - ky0) * stride;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i half = _mm_set1_epi32(FILTER_Y_HALF);
+	const __m128i tmp_half = _mm_set1_epi16(FILTER_TMP_HALF);
+	int i, j;
+
+	for(i = 0; i + 16 <= n; i += 16)
+	{
+		__m128i f0 = _mm_loadu_si128((const __m128i *) (first + i));
+		__m128i f1 = _mm_loadu_si128((const __m128i *) (first + i + 8));
+		__m128i lo0 = f0, hi0 = f0, lo1 = f1, hi1 = f1, flat, same;
+		__m128i acc0 = zero, acc1 = zero, acc2 = zero, acc3 = zero;
+		for(j = 0; j < taps; j += 2)
+		{
+			const Uint16 *ra = tmp + (size_t) (index[j] - ky0) * stride + i;
+			const Uint16 *rb = tmp + (size_t) (index[j + 1] - ky0) * stride + i;
+			__m128i a0 = _mm_loadu_si128((const __m128i *) ra), a1 = _mm_loadu_si128((const __m128i *) (ra + 8));
+			__m128i b0 = _mm_loadu_si128((const __m128i *) rb), b1 = _mm_loadu_si128((const __m128i *) (rb + 8));
+			__m128i w = _mm_set1_epi32(FILTER_PAIR(fixed, j));
+			lo0 = _mm_min_epu16(lo0, _mm_min_epu16(a0, b0));
+			hi0 = _mm_max_epu16(hi0, _mm_max_epu16(a0, b0));
+			lo1 = _mm_min_epu16(lo1, _mm_min_epu16(a1, b1));
+			hi1 = _mm_max_epu16(hi1, _mm_max_epu16(a1, b1));
+			acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(a0, b0), w));
+			acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(a0, b0), w));
+			acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi16(a1, b1), w));
+			acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi16(a1, b1), w));
+		}
+		acc0 = _mm_srai_epi32(_mm_add_epi32(acc0, half), FILTER_Y_SHIFT);
+		acc1 = _mm_srai_epi32(_mm_add_epi32(acc1, half), FILTER_Y_SHIFT);
+		acc2 = _mm_srai_epi32(_mm_add_epi32(acc2, half), FILTER_Y_SHIFT);
+		acc3 = _mm_srai_epi32(_mm_add_epi32(acc3, half), FILTER_Y_SHIFT);
+		acc0 = _mm_packus_epi16(_mm_packs_epi32(acc0, acc1), _mm_packs_epi32(acc2, acc3));
+		flat = _mm_packus_epi16(FILTER_ROUND_SSE(f0), FILTER_ROUND_SSE(f1));
+		same = _mm_packs_epi16(_mm_cmpeq_epi16(FILTER_ROUND_SSE(lo0), FILTER_ROUND_SSE(hi0)),
+				_mm_cmpeq_epi16(FILTER_ROUND_SSE(lo1), FILTER_ROUND_SSE(hi1)));
+		_mm_storeu_si128((__m128i *) (out + i), _mm_blendv_epi8(acc0, flat, same));
+	}
+	/* The last few pixels of rows not a multiple of 4 wide */
+	for(; i < n; i++)
+	{
+		int acc = 0, bPelDelta = 0;
+		for(j = 0; j < taps; ++j)
+		{
+			Uint16 pel2 = tmp[(size_t) (index[j] - ky0) * stride + i];
+			bPelDelta |= FILTER_TMP_ROUND(pel2) != FILTER_TMP_ROUND(first[i]);
+			acc += pel2 * fixed[j];
+		}
+		acc = (acc + FILTER_Y_HALF) >> FILTER_Y_SHIFT;
+		out[i] = bPelDelta ? (Pixel)CLAMP(acc, 0, 255) : FILTER_TMP_ROUND(first[i]);
+	}
+} /* filter_blend_sse41 */
+
+__attribute__((target("sse4.1")))
+static void filter_row_y_sse41(const Uint16 *tmp, int ky0, int len, const filter_Table *Y, int y,
+					double *scratch, Uint8 *delta, Uint8 *out)
+{
+	filter_blend_sse41(tmp, ky0, len, len, Y->index + (size_t) y * Y->taps, Y->fixed + (size_t) y * Y->taps,
+			Y->taps, out);
+} /* filter_row_y_sse41 */
+
+/* AVX2 | Two dst pixels per vector, one in each 128-bit lane */
+__attribute__((target("avx2")))
+static void filter_row_x_avx2(const Uint8 *in, Uint16 *out, const filter_Table *X)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i half = _mm256_set1_epi32(FILTER_X_HALF);
+	const __m256i most = _mm256_set1_epi16(FILTER_TMP_MAX);
+	int x, j;
+	Uint32 a32, b32;
+
+	for(x = 0; x + 2 <= X->dstlen; x += 2, out += 8)
+	{
+		const int *index0 = X->index + (size_t) x * X->taps, *index1 = index0 + X->taps;
+		const Sint16 *fixed0 = X->fixed + (size_t) x * X->taps, *fixed1 = fixed0 + X->taps;
+		__m256i first, lo, hi, same, acc = zero;
+		memcpy(&a32, in + index0[0] * 4, 4);
+		memcpy(&b32, in + index1[0] * 4, 4);
+		first = lo = hi = _mm256_setr_epi32(a32, 0, 0, 0, b32, 0, 0, 0);
+		for(j = 0; j < X->taps; j += 2)
+		{
+			__m256i a, b, ab;
+			memcpy(&a32, in + index0[j] * 4, 4);
+			memcpy(&b32, in + index1[j] * 4, 4);
+			a = _mm256_setr_epi32(a32, 0, 0, 0, b32, 0, 0, 0);
+			memcpy(&a32, in + index0[j + 1] * 4, 4);
+			memcpy(&b32, in + index1[j + 1] * 4, 4);
+			b = _mm256_setr_epi32(a32, 0, 0, 0, b32, 0, 0, 0);
+			lo = _mm256_min_epu8(lo, _mm256_min_epu8(a, b));
+			hi = _mm256_max_epu8(hi, _mm256_max_epu8(a, b));
+			ab = _mm256_unpacklo_epi8(_mm256_unpacklo_epi8(a, b), zero);
+			acc = _mm256_add_epi32(acc, _mm256_madd_epi16(ab, _mm256_inserti128_si256(
+				_mm256_set1_epi32(FILTER_PAIR(fixed0, j)), _mm_set1_epi32(FILTER_PAIR(fixed1, j)), 1)));
+		}
+		acc = _mm256_srai_epi32(_mm256_add_epi32(acc, half), FILTER_X_SHIFT);
+		acc = _mm256_min_epu16(_mm256_packus_epi32(acc, acc), most);
+		first = _mm256_slli_epi16(_mm256_unpacklo_epi8(first, zero), FILTER_TMP_SHIFT);
+		same = _mm256_cmpeq_epi8(lo, hi);
+		acc = _mm256_blendv_epi8(acc, first, _mm256_unpacklo_epi8(same, same));
+		_mm_storel_epi64((__m128i *) out, _mm256_castsi256_si128(acc));
+		_mm_storel_epi64((__m128i *) (out + 4), _mm256_extracti128_si256(acc, 1));
+	}
+	/* An odd pixel left over */
+	if(x < X->dstlen)
+		filter_pixel_sse41(in, X->index + (size_t) x * X->taps, X->fixed + (size_t) x * X->taps, X->taps, out);
+} /* filter_row_x_avx2 */
+
+/* Eight dst pixels per iteration. Packing works within 128-bit lanes, so
+   the results come out with their middle quarters swapped. */
+__attribute__((target("avx2")))
+static void filter_row_y_avx2(const Uint16 *tmp, int ky0, int len, const filter_Table *Y, int y,
+					double *scratch, Uint8 *delta, Uint8 *out)
+{
+	const int *index = Y->index + (size_t) y * Y->taps;
+	const Sint16 *fixed = Y->fixed + (size_t) y * Y->taps;
+	const Uint16 *first = tmp + (size_t) (index[0] - ky0) * len;
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i half = _mm256_set1_epi32(FILTER_Y_HALF);
+	const __m256i tmp_half = _mm256_set1_epi16(FILTER_TMP_HALF);
+	int i, j;
+
+	for(i = 0; i + 32 <= len; i += 32)
+	{
+		__m256i f0 = _mm256_loadu_si256((const __m256i *) (first + i));
+		__m256i f1 = _mm256_loadu_si256((const __m256i *) (first + i + 16));
+		__m256i lo0 = f0, hi0 = f0, lo1 = f1, hi1 = f1, flat, same;
+		__m256i acc0 = zero, acc1 = zero, acc2 = zero, acc3 = zero;
+		for(j = 0; j < Y->taps; j += 2)
+		{
+			const Uint16 *ra = tmp + (size_t) (index[j] - ky0) * len + i;
+			const Uint16 *rb = tmp + (size_t) (index[j + 1] - ky0) * len + i;
+			__m256i a0 = _mm256_loadu_si256((const __m256i *) ra), a1 = _mm256_loadu_si256((const __m256i *) (ra + 16));
+			__m256i b0 = _mm256_loadu_si256((const __m256i *) rb), b1 = _mm256_loadu_si256((const __m256i *) (rb + 16));
+			__m256i w = _mm256_set1_epi32(FILTER_PAIR(fixed, j));
+			lo0 = _mm256_min_epu16(lo0, _mm256_min_epu16(a0, b0));
+			hi0 = _mm256_max_epu16(hi0, _mm256_max_epu16(a0, b0));
+			lo1 = _mm256_min_epu16(lo1, _mm256_min_epu16(a1, b1));
+			hi1 = _mm256_max_epu16(hi1, _mm256_max_epu16(a1, b1));
+			acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi16(a0, b0), w));
+			acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi16(a0, b0), w));
+			acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi16(a1, b1), w));
+			acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi16(a1, b1), w));
+		}
+		acc0 = _mm256_srai_epi32(_mm256_add_epi32(acc0, half), FILTER_Y_SHIFT);
+		acc1 = _mm256_srai_epi32(_mm256_add_epi32(acc1, half), FILTER_Y_SHIFT);
+		acc2 = _mm256_srai_epi32(_mm256_add_epi32(acc2, half), FILTER_Y_SHIFT);
+		acc3 = _mm256_srai_epi32(_mm256_add_epi32(acc3, half), FILTER_Y_SHIFT);
+		acc0 = _mm256_packus_epi16(_mm256_packs_epi32(acc0, acc1), _mm256_packs_epi32(acc2, acc3));
+		flat = _mm256_packus_epi16(FILTER_ROUND_AVX2(f0), FILTER_ROUND_AVX2(f1));
+		same = _mm256_packs_epi16(_mm256_cmpeq_epi16(FILTER_ROUND_AVX2(lo0), FILTER_ROUND_AVX2(hi0)),
+				_mm256_cmpeq_epi16(FILTER_ROUND_AVX2(lo1), FILTER_ROUND_AVX2(hi1)));
+		acc0 = _mm256_permute4x64_epi64(_mm256_blendv_epi8(acc0, flat, same), 0xd8);
+		_mm256_storeu_si256((__m256i *) (out + i), acc0);
+	}
+	/* Hand what is left to the 128-bit version */
+	if(i < len)
+		filter_blend_sse41(tmp + i, ky0, len, len - i, index, fixed, Y->taps, out + i);
+} /* filter_row_y_avx2 */
+#endif
+
+/* Kernels in use; see SDL_ResizeKernels() */
+static void (*filter_row_x)(const Uint8 *in, Uint16 *out, const filter_Table *X) = filter_row_x_c;
+static void (*filter_row_y)(const Uint16 *tmp, int ky0, int len, const filter_Table *Y, int y,
+					double *acc, Uint8 *delta, Uint8 *out) = filter_row_y_c;
+
+/* Box filter, whole-number scale | Every dst pixel gets all its weight from
+   one src pixel, so we can copy pixels instead of filtering them. The src
+   pixel for dst pixel i is ceil(i / scale - 0.5), the one
+   filter_box_interp() picks. */
+static int filter_box_source(int i, int scale, int srclen)
+{
+	int n = 2 * i - scale;
+	int j = n <= 0 ? 0 : (n + 2 * scale - 1) / (2 * scale);
+	return j < srclen ? j : srclen - 1;
+} /* filter_box_source */
+
+/* Same packed layout, so pixels can be copied as they are */
+static int filter_same_format(SDL_PixelFormat *a, SDL_PixelFormat *b)
+{
+	return filter_packed(a) && filter_packed(b) && a->Rmask == b->Rmask && a->Gmask == b->Gmask &&
+		a->Bmask == b->Bmask && a->Amask == b->Amask;
+}
+
+/* Widen w src pixels by scale into out: a short first run, runs of scale
+   in between, and whatever is left for the last pixel */
+static void filter_widen_c(const Uint32 *in, Uint32 *out, int w, int scale, int dstw)
+{
+	int x, k, o = 0, n;
+	for(x = 0; x < w; x++)
+	{
+		n = x == 0 ? scale / 2 + 1 : scale;
+		if(x == w - 1 || o + n > dstw)
+			n = dstw - o;
+		for(k = 0; k < n; k++)
+			out[o + k] = in[x];
+		o += n;
+	}
+} /* filter_widen_c */
+
+#ifdef FILTER_X86
+/* SSE2 | Four dst pixels per store */
+__attribute__((target("sse2")))
+static void filter_widen_sse2(const Uint32 *in, Uint32 *out, int w, int scale, int dstw)
+{
+	int x = 1, k, o = scale / 2 + 1;
+	if(w < 3 || o > dstw)
+	{
+		filter_widen_c(in, out, w, scale, dstw);
+		return;
+	}
+	for(k = 0; k < o; k++)
+		out[k] = in[0];
+	/* Pixels 1 to w - 2 all get exactly `scale` */
+	if(scale == 2)
+	{
+		for(; x + 4 <= w - 1; x += 4, o += 8)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *) (in + x));
+			_mm_storeu_si128((__m128i *) (out + o), _mm_unpacklo_epi32(v, v));
+			_mm_storeu_si128((__m128i *) (out + o + 4), _mm_unpackhi_epi32(v, v));
+		}
+	}
+	else if(scale >= 4)
+	{
+		for(; x < w - 1; x++, o += scale)
+		{
+			__m128i v = _mm_set1_epi32(in[x]);
+			for(k = 0; k + 4 <= scale; k += 4)
+				_mm_storeu_si128((__m128i *) (out + o + k), v);
+			for(; k < scale; k++)
+				out[o + k] = in[x];
+		}
+	}
+	for(; x < w - 1; x++, o += scale)
+		for(k = 0; k < scale; k++)
+			out[o + k] = in[x];
+	for(; o < dstw; o++)
+		out[o] = in[w - 1];
+} /* filter_widen_sse2 */
+#endif
+
+static void (*filter_widen)(const Uint32 *in, Uint32 *out, int w, int scale, int dstw) = filter_widen_c;
+
+/* dst rows [dy0, dy1) by pixel replication. Rows that come from the same
+   src row are copied from the one before. */
+static void filter_replicate(SDL_Surface *dst, SDL_Surface *src, int dy0, int dy1)
+{
+	int sx = dst->w / src->w, sy = dst->h / src->h;
+	int y, j, last = -1;
+	Uint8 *out, *prev = NULL;
+
+	for(y = dy0; y < dy1; y++)
+	{
+		j = filter_box_source(y, sy, src->h);
+		out = (Uint8 *) dst->pixels + y * dst->pitch;
+		if(j == last)
+			memcpy(out, prev, dst->w * 4);
+		else
+			filter_widen((const Uint32 *) ((Uint8 *) src->pixels + j * src->pitch), (Uint32 *) out, src->w, sx, dst->w);
+		last = j;
+		prev = out;
+	}
+} /* filter_replicate */
+
+static void filter_zoom_rows(filter_Job *job)
+{
+	int len = job->dst->w * 4;
+	int ky0, ky1;			/* src rows feeding dst rows [dy0, dy1) */
+	int i, j, k;
+	Uint8 *row, *out, *delta;
+	Uint16 *tmp;
+	double *acc;
+
+	ky0 = job->src->h;
+	ky1 = 0;
+	for(i = job->dy0; i < job->dy1; ++i)
+		for(j = 0; j < job->Y->list[i].n; ++j)
+		{
+			if(job->Y->list[i].p[j].pixel < ky0) ky0 = job->Y->list[i].p[j].pixel;
+			if(job->Y->list[i].p[j].pixel >= ky1) ky1 = job->Y->list[i].p[j].pixel + 1;
+		}
+	if(ky1 <= ky0)
+	{
+		job->nRet = 0;
+		return;
+	}
 
-	} /* next dst column */
-	nRet = 0; /* success */
+	row = (Uint8 *)malloc(job->src->w * 4);
+	tmp = (Uint16 *)malloc((size_t) (ky1 - ky0) * len * sizeof(Uint16));
+	out = (Uint8 *)malloc(len);
+	delta = (Uint8 *)malloc(len);
+	acc = (double *)malloc(len * sizeof(double));
+	job->nRet = -1;
+	if(row == NULL || tmp == NULL || out == NULL || delta == NULL || acc == NULL)
+		goto __rows_cleanup;
+
+	/* Stretch every src row we need horizontally into tmp... */
+	for(k = ky0; k < ky1; ++k)
+	{
+		filter_load_row(job->src, k, row);
+		filter_row_x(row, tmp + (size_t) (k - ky0) * len, job->X);
+	}
+	/* ...then blend tmp rows vertically into each dst row */
+	for(i = job->dy0; i < job->dy1; ++i)
+	{
+		filter_row_y(tmp, ky0, len, job->Y, i, acc, delta, out);
+		filter_store_row(job->dst, i, out);
+	}
+	job->nRet = 0;
 
-__zoom_cleanup:
+__rows_cleanup:
+	free(row);
 	free(tmp);
+	free(out);
+	free(delta);
+	free(acc);
+} /* filter_zoom_rows */
+
+/* Run bands from the pool until none are left to start. Call with
+   filter_pool.lock held. */
+static void filter_pool_drain(void)
+{
+	int i;
+	while(filter_pool.next < filter_pool.count)
+	{
+		i = filter_pool.next++;
+		pthread_mutex_unlock(&filter_pool.lock);
+		filter_zoom_rows(&filter_pool.jobs[i]);
+		pthread_mutex_lock(&filter_pool.lock);
+		if(--filter_pool.left == 0)
+			pthread_cond_signal(&filter_pool.done);
+	}
+} /* filter_pool_drain */
 
-	/* free the memory allocated for vertical filter weights */
-	for(i = 0; i < dst->h; ++i)
-		free(contribY[i].p);
-	free(contribY);
+static void *filter_pool_main(void *arg)
+{
+	pthread_mutex_lock(&filter_pool.lock);
+	for(;;)
+	{
+		filter_pool_drain();
+		pthread_cond_wait(&filter_pool.work, &filter_pool.lock);
+	}
+	return NULL;
+} /* filter_pool_main */
 
+/* One worker per CPU besides the zooming thread. If some cannot be
+   started, the rest share their bands. */
+static void filter_pool_start(void)
+{
+	pthread_t thread;
+	int t, threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	threads = CLAMP(threads, 1, FILTER_MAX_THREADS);
+	for(t = 1; t < threads; t++)
+	{
+		if(0 == pthread_create(&thread, NULL, filter_pool_main, NULL))
+			pthread_detach(thread);
+	}
+} /* filter_pool_start */
+
+/* Run count bands, on the pool if it is free, or else on this thread */
+static void filter_pool_run(filter_Job *jobs, int count)
+{
+	int t;
+
+	if(count > 1 && 0 == pthread_once(&filter_pool_once, filter_pool_start) &&
+			0 == pthread_mutex_trylock(&filter_pool.busy))
+	{
+		pthread_mutex_lock(&filter_pool.lock);
+		filter_pool.jobs = jobs;
+		filter_pool.count = count;
+		filter_pool.next = 0;
+		filter_pool.left = count;
+		pthread_cond_broadcast(&filter_pool.work);
+		filter_pool_drain();
+		while(filter_pool.left > 0)
+			pthread_cond_wait(&filter_pool.done, &filter_pool.lock);
+		filter_pool.jobs = NULL;
+		filter_pool.count = 0;
+		pthread_mutex_unlock(&filter_pool.lock);
+		pthread_mutex_unlock(&filter_pool.busy);
+		return;
+	}
+	for(t = 0; t < count; t++)
+		filter_zoom_rows(&jobs[t]);
+} /* filter_pool_run */
+
+/* Only dst rows [dy0, dy1) are written, and only the src rows they need are read */
+static int filter_zoom2(SDL_Surface *dst, SDL_Surface *src, double (*filterf)(double), double fwidth, int dy0, int dy1)
+{
+	filter_Job jobs[FILTER_MAX_THREADS];
+	const filter_Table *X, *Y;
+	int threads, share, t;
+	int nRet = 0;
+
+	if(dy1 <= dy0)
+		return 0;
+
+	/* Whole-number box scaling needs no tables at all */
+	if(filterf == filter_box_interp && dst->w % src->w == 0 && dst->h % src->h == 0 &&
+			filter_same_format(src->format, dst->format))
+	{
+		filter_replicate(dst, src, dy0, dy1);
+		return 0;
+	}
+
+	/* The tables are shared by every band; our references keep them
+	   alive, without the cache lock, until we are done */
+	X = filter_table(src->w, dst->w, filterf, fwidth);
+	Y = X ? filter_table(src->h, dst->h, filterf, fwidth) : NULL;
+	if(X == NULL || Y == NULL)
+	{
+		if(X != NULL)
+			filter_put(X);
+		return -1;
+	}
+
+	/* Split the rows into bands, one per thread */
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(threads > (dy1 - dy0) / FILTER_ROWS_PER_THREAD)
+		threads = (dy1 - dy0) / FILTER_ROWS_PER_THREAD;
+	threads = CLAMP(threads, 1, FILTER_MAX_THREADS);
+	share = (dy1 - dy0 + threads - 1) / threads;
+	for(t = 0; t < threads; t++)
+	{
+		jobs[t].dst = dst;
+		jobs[t].src = src;
+		jobs[t].X = X;
+		jobs[t].Y = Y;
+		jobs[t].dy0 = dy0 + t * share;
+		jobs[t].dy1 = jobs[t].dy0 + share < dy1 ? jobs[t].dy0 + share : dy1;
+	}
+	filter_pool_run(jobs, threads);
+	for(t = 0; t < threads; t++)
+	{
+		if(jobs[t].nRet != 0)
+			nRet = -1;
+	}
+
+	filter_put(X);
+	filter_put(Y);
 	return nRet;
 } /* zoom */
 
-static SDL_Surface *filter_resizexy(SDL_Surface* source,int new_w, int new_h, int filter)
-{	
+static void filter_select(int filter, double (**fp)(double), double *sp)
+{
     //f and s need to be complementary... one as filter, one as support.
 	double (*f)(double) ; //function pointer
 	double s; //support
-    SDL_Surface *temp, *dest;
 
 	const double box_support = 0.5,
 			triangle_support = 1.0,
@@ -617,6 +1248,17 @@ static SDL_Surface *filter_resizexy(SDL_Surface* source,int new_w, int new_h, in
         case 7 : f=filter_Lanczos3_interp;	s=Lanczos3_support;	break;
 		default: f=filter_Lanczos3_interp;	s=Lanczos3_support;	break;
 	}
+	*fp = f;
+	*sp = s;
+}
+
+static SDL_Surface *filter_resizexy(SDL_Surface* source,int new_w, int new_h, int filter)
+{	
+	double (*f)(double) ; //function pointer
+	double s; //support
+    SDL_Surface *temp, *dest;
+
+	filter_select(filter, &f, &s);
 
     //Make new surface and send it in to the real filter
 	temp = SDL_CreateRGBSurface(SDL_SWSURFACE | SDL_SRCALPHA,
@@ -628,7 +1270,7 @@ static SDL_Surface *filter_resizexy(SDL_Surface* source,int new_w, int new_h, in
 	if SDL_MUSTLOCK(source) SDL_LockSurface(source);
 	if SDL_MUSTLOCK(dest)   SDL_LockSurface(dest);
 
-	filter_zoom2(dest, source, f, s ); 
+	filter_zoom2(dest, source, f, s, 0, new_h ); 
 
 	if SDL_MUSTLOCK(dest)   SDL_UnlockSurface(dest);
 	if SDL_MUSTLOCK(source) SDL_UnlockSurface(source);	
@@ -638,3 +1280,71 @@ static SDL_Surface *filter_resizexy(SDL_Surface* source,int new_w, int new_h, in
 
 	return dest;
 }
+
+/* Redraw into dst, already src scaled up or down, only the rows that src
+   rows [y0, y1) contribute to. Neither surface is freed. */
+int SDL_ResizeRowsInto(SDL_Surface *src, SDL_Surface *dst, int y0, int y1, int filter, SDL_Rect *changed)
+{
+	double (*f)(double) ; //function pointer
+	double s; //support
+	double yscale, reach;
+	int dy0, dy1, nRet;
+
+	if (!src || !dst) return -1;
+	filter_select(filter, &f, &s);
+
+	//a src row reaches dst rows within the filter's support of it
+	yscale = (double) dst->h / (double) src->h;
+	reach = (yscale < 1.0 ? s / yscale : s) + 1.0;
+	dy0 = (int) floor((y0 - reach) * yscale);
+	dy1 = (int) ceil((y1 + reach) * yscale);
+	dy0 = CLAMP(dy0, 0, dst->h);
+	dy1 = CLAMP(dy1, dy0, dst->h);
+
+	if SDL_MUSTLOCK(src) SDL_LockSurface(src);
+	if SDL_MUSTLOCK(dst) SDL_LockSurface(dst);
+
+	nRet = filter_zoom2(dst, src, f, s, dy0, dy1);
+
+	if SDL_MUSTLOCK(dst) SDL_UnlockSurface(dst);
+	if SDL_MUSTLOCK(src) SDL_UnlockSurface(src);
+
+	if (changed)
+	{
+		changed->x = 0;
+		changed->y = dy0;
+		changed->w = dst->w;
+		changed->h = dy1 - dy0;
+	}
+	return nRet;
+}
+
+const char* SDL_ResizeKernels(int reference)
+{
+	if (reference)
+	{
+		filter_row_x = filter_row_x_double;
+		filter_row_y = filter_row_y_double;
+		return "double";
+	}
+#ifdef FILTER_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		filter_widen = filter_widen_sse2;
+	if (__builtin_cpu_supports("avx2"))
+	{
+		filter_row_x = filter_row_x_avx2;
+		filter_row_y = filter_row_y_avx2;
+		return "avx2";
+	}
+	if (__builtin_cpu_supports("sse4.1"))
+	{
+		filter_row_x = filter_row_x_sse41;
+		filter_row_y = filter_row_y_sse41;
+		return "sse4.1";
+	}
+#endif
+	filter_row_x = filter_row_x_c;
+	filter_row_y = filter_row_y_c;
+	return "c";
+}
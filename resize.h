@@ -11,6 +11,19 @@
 SDL_Surface* SDL_ResizeFactor(SDL_Surface *image, float scalefactor,    int filter);
 SDL_Surface* SDL_ResizeXY    (SDL_Surface *image, int new_w, int new_h, int filter);
 
+//Redraws only the part of dst, a resized copy of src, that depends on rows
+//[y0, y1) of src, and reports that part in *changed (if not NULL).
+//Neither surface is freed. Returns 0 on success.
+int SDL_ResizeRowsInto(SDL_Surface *src, SDL_Surface *dst, int y0, int y1, int filter, SDL_Rect *changed);
+
+//Picks fixed-point kernels (Q14 weights) for this CPU, or the original
+//double-precision code if reference is nonzero, and returns the name of the
+//set chosen. Fixed point is within 1 of the double results per channel,
+//except rarely for box-filter shrinks by a fraction, where the original's
+//shortcut for flat areas can land a channel a few further off.
+//Until this is called the plain C fixed-point kernels are used.
+const char* SDL_ResizeKernels(int reference);
+
 //Here are overloaded C++ versions, with filter default as high quality.
 #ifdef __cplusplus
 SDL_Surface* SDL_Resize(SDL_Surface *image, float scalefactor,    int filter = 7);
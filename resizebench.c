@@ -0,0 +1,131 @@
+// resizebench.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// sonify-resizebench: time the fixed-point resize kernels against the
+// original double-precision code, and check how far apart they land.
+// Exits with 2 if any channel is more than 1 off.
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+// SDL Includes
+#include <SDL_image.h>
+#include <SDL.h>
+// 
+#include "resize.h"
+
+#define FRAMES 10
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static SDL_Surface * surface(int w, int h) {
+	SDL_Surface * s = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32, 0xff0000, 0xff00, 0xff, 0);
+	if (s == NULL) {
+		fprintf(stderr, "CreateRGBSurface failed: %s\n", SDL_GetError());
+		exit(1);
+	}
+	return s;
+}
+
+// Milliseconds per resize of all of `src` into `dst`
+static double time_resize(SDL_Surface * src, SDL_Surface * dst, int filter) {
+	double start;
+	int i;
+	SDL_ResizeRowsInto(src, dst, 0, src->h, filter, NULL);
+	start = now();
+	for (i = 0; i < FRAMES; i++) {
+		SDL_ResizeRowsInto(src, dst, 0, src->h, filter, NULL);
+	}
+	return (now() - start) * 1000 / FRAMES;
+}
+
+int main(int argc, char * argv[]) {
+	const int filters[] = { 1, 6, 7 };
+	const char * names[] = { "box", "mitchell", "lanczos3" };
+	SDL_Surface * src, * ref, * dst;
+	int scale = argc > 2 ? atoi(argv[2]) : 2;
+	int f, x, y, c;
+	long too_far = 0;
+
+	// Our image, or noise, the worst case for rounding
+	if (argc > 1) {
+		SDL_Surface * image = IMG_Load(argv[1]);
+		if (image == NULL) {
+			fprintf(stderr, "Load failes: %s\n", IMG_GetError());
+			exit(1);
+		}
+		src = surface(image->w, image->h);
+		SDL_BlitSurface(image, NULL, src, NULL);
+		SDL_FreeSurface(image);
+	} else {
+		Uint32 * pixels;
+		src = surface(960, 540);
+		srand(1);
+		for (y = 0; y < src->h; y++) {
+			pixels = (Uint32 *) ((Uint8 *) src->pixels + y * src->pitch);
+			for (x = 0; x < src->w; x++) {
+				pixels[x] = rand() & 0xffffff;
+			}
+		}
+	}
+	if (scale < 1) {
+		scale = 1;
+	}
+	ref = surface(src->w * scale, src->h * scale);
+	dst = surface(src->w * scale, src->h * scale);
+
+	printf("%dx%d -> %dx%d\n", src->w, src->h, dst->w, dst->h);
+	printf("%-9s %-8s %10s %10s %8s %8s %8s\n", "filter", "kernels", "ms/frame", "speedup", "max err", "% off 1", "off >1");
+	for (f = 0; f < 3; f++) {
+		const char * kernels;
+		double ref_ms, ms;
+		long off1 = 0, off2 = 0;
+		int worst = 0;
+		SDL_ResizeKernels(1);
+		ref_ms = time_resize(src, ref, filters[f]);
+		kernels = SDL_ResizeKernels(0);
+		ms = time_resize(src, dst, filters[f]);
+		for (y = 0; y < dst->h; y++) {
+			Uint8 * a = (Uint8 *) ref->pixels + y * ref->pitch;
+			Uint8 * b = (Uint8 *) dst->pixels + y * dst->pitch;
+			for (c = 0; c < dst->w * 4; c++) {
+				int err = abs(a[c] - b[c]);
+				if (err > worst) {
+					worst = err;
+				}
+				off1 += err == 1;
+				off2 += err > 1;
+			}
+		}
+		printf("%-9s %-8s %10.1f %10s\n", names[f], "double", ref_ms, "1.0x");
+		printf("%-9s %-8s %10.1f %9.1fx %8d %8.3f %8ld\n", names[f], kernels, ms, ref_ms / ms, worst,
+				100.0 * off1 / ((double) dst->w * dst->h * 4), off2);
+		too_far += off2;
+	}
+	SDL_FreeSurface(src);
+	SDL_FreeSurface(ref);
+	SDL_FreeSurface(dst);
+	if (too_far > 0) {
+		fprintf(stderr, "%ld channels more than 1 off\n", too_far);
+		exit(2);
+	}
+	exit(0);
+}
@@ -0,0 +1,43 @@
+// ring.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <stdlib.h>
+#include "ring.h"
+
+int ring_init(ring_t * ring, unsigned int count, size_t slot_size) {
+	unsigned int n = 1;
+	while (n < count) {
+		n <<= 1;
+	}
+	// Keep slots 16-byte aligned for the SIMD kernels
+	slot_size = (slot_size + 15) & ~((size_t) 15);
+	ring->slots = (char *) calloc(n, slot_size);
+	if (ring->slots == NULL) {
+		return -1;
+	}
+	ring->slot_size = slot_size;
+	ring->mask = n - 1;
+	ring->head = 0;
+	ring->tail = 0;
+	return 0;
+}
+
+void ring_free(ring_t * ring) {
+	free(ring->slots);
+	ring->slots = NULL;
+}
@@ -0,0 +1,72 @@
+// ring.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// Single-producer/single-consumer ring of fixed-size slots. Neither side
+// locks or allocates, so either end may live on the JACK thread. The
+// producer fills ring_write_slot() in place and then ring_commit()s it;
+// the consumer reads ring_read_slot() in place and then ring_release()s it.
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+
+typedef struct {
+	char * slots;
+	size_t slot_size;
+	unsigned int mask;		// slot count - 1; the count is a power of 2
+	unsigned int head;		// next slot to write, owned by the producer
+	unsigned int tail;		// next slot to read, owned by the consumer
+} ring_t;
+
+// Room for at least `count` slots of `slot_size` bytes. Returns 0 on
+// success, -1 if out of memory.
+int ring_init(ring_t * ring, unsigned int count, size_t slot_size);
+void ring_free(ring_t * ring);
+
+// Slots waiting to be read
+static inline unsigned int ring_fill(ring_t * ring) {
+	return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+// Producer | Next free slot, or NULL if the ring is full
+static inline void * ring_write_slot(ring_t * ring) {
+	unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->mask) {
+		return NULL;
+	}
+	return ring->slots + (head & ring->mask) * ring->slot_size;
+}
+
+static inline void ring_commit(ring_t * ring) {
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+// Consumer | Oldest filled slot, or NULL if the ring is empty
+static inline void * ring_read_slot(ring_t * ring) {
+	unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail) {
+		return NULL;
+	}
+	return ring->slots + (tail & ring->mask) * ring->slot_size;
+}
+
+static inline void ring_release(ring_t * ring) {
+	__atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+#endif
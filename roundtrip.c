@@ -0,0 +1,364 @@
+// roundtrip.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// sonify-roundtrip: encode images to audio and decode them straight back,
+// offline, over a grid of ms times and frequency scales, and report how
+// much of each image survives and how fast the round trip runs.
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <SDL_image.h>
+// 
+#include "sonify.h"
+#include "tones.h"
+#include "wavebank.h"
+#include "render.h"
+#include "detector.h"
+#include "bands.h"
+#include "cache.h"
+#include "hsl.h"
+#include "math_util.h"
+#include "color_util.h"
+#include "hopclock.h"
+
+// Longest --ms or --scale list
+#define MAX_GRID 16
+// Hops rendered, then handed to the detector, at once
+#define DETECT_HOPS 64
+
+typedef struct {
+	double psnr;			// decoded pixels against a perfect decode, in dB
+	double psnr_original;		// and against the original image
+	double hue_err, light_err;	// against the tone map, as fractions of the range
+	double pixels_per_sec;		// encode and decode together
+} result_t;
+
+// gd truecolor order, as sonify-decode writes
+static const hsl_layout_t rgb_layout = { 16, 8, 0, 0 };
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// Up to `max` comma-separated positive numbers; returns how many, 0 if any
+// is bad
+static int parse_list(const char * s, float * out, int max) {
+	int n = 0;
+	char * end;
+	while (n < max) {
+		out[n] = strtod(s, &end);
+		if (end == s || out[n] <= 0) {
+			return 0;
+		}
+		n++;
+		if (*end == '\0') {
+			return n;
+		}
+		if (*end != ',') {
+			return 0;
+		}
+		s = end + 1;
+	}
+	return 0;
+}
+
+// 8-bit RGB peak signal to noise ratio from a sum of squared differences
+// over `n` pixels
+static double psnr(double squared, unsigned int n) {
+	if (squared == 0) {
+		return INFINITY;
+	}
+	return 10 * log10(255.0 * 255 * 3 * n / squared);
+}
+
+static double squared_error(color a, color b) {
+	double dr = a.r - b.r, dg = a.g - b.g, db = a.b - b.b;
+	return dr * dr + dg * dg + db * db;
+}
+
+static color unpack(uint32_t pixel) {
+	color c;
+	c.r = pixel >> rgb_layout.rshift;
+	c.g = pixel >> rgb_layout.gshift;
+	c.b = pixel >> rgb_layout.bshift;
+	return c;
+}
+
+// The original pixels of `path`, in tone map order. Returns NULL after
+// printing why not.
+static color * load_reference(const char * path, const tonemap_t * map) {
+	SDL_Surface * image = IMG_Load(path);
+	if (image == NULL) {
+		fprintf(stderr, "Load failes: %s\n", IMG_GetError());
+		return NULL;
+	}
+	if ((unsigned int) image->w != map->width || (unsigned int) image->h != map->height) {
+		fprintf(stderr, "%s does not match its tone map\n", path);
+		SDL_FreeSurface(image);
+		return NULL;
+	}
+	color * ref = (color *) malloc((size_t) map->count * sizeof(color));
+	if (ref == NULL) {
+		fprintf(stderr,"memory allocation failed\n");
+		exit(3);
+	}
+	unsigned int i;
+	if SDL_MUSTLOCK(image) SDL_LockSurface(image);
+	for (i = 0; i < map->count; i++) {
+		ref[i] = get_color(image, i % map->width, i / map->width);
+	}
+	if SDL_MUSTLOCK(image) SDL_UnlockSurface(image);
+	SDL_FreeSurface(image);
+	return ref;
+}
+
+// A perfect decode: the tone map drawn back at full saturation, as the
+// decoder draws it. Sound carries no saturation, so this is as close to
+// the original as any setting can get.
+static color * perfect_decode(const tonemap_t * map) {
+	float hue[DETECT_HOPS], light[DETECT_HOPS];
+	uint32_t rgb[DETECT_HOPS];
+	color * out = (color *) malloc((size_t) map->count * sizeof(color));
+	unsigned int i, j, n;
+	if (out == NULL) {
+		fprintf(stderr,"memory allocation failed\n");
+		exit(3);
+	}
+	for (i = 0; i < map->count; i += n) {
+		n = map->count - i < DETECT_HOPS ? map->count - i : DETECT_HOPS;
+		for (j = 0; j < n; j++) {
+			hue[j] = tonemap_hue(map, i + j);
+			light[j] = 1 - tonemap_amp(map, i + j);
+		}
+		hsl_to_rgb_row(hue, light, n, &rgb_layout, rgb);
+		for (j = 0; j < n; j++) {
+			out[i + j] = unpack(rgb[j]);
+		}
+	}
+	return out;
+}
+
+// Play every entry of `table` as sonify-encode does, and decode each batch
+// of hops as sonify-decode does. `hops` has room for DETECT_HOPS of them
+// and one more frame.
+static void round_trip(const tone_table_t * table, const wavebank_t * bank, detector_t * d, hopclock_t clock,
+		const color * perfect, const color * original, sample_t * hops, result_t * r) {
+	int lanes = table->lanes, steps = table->count / lanes;
+	unsigned int hop_frames = hopclock_frames(&clock);
+	float freqs[MAX_LANES], amps[MAX_LANES];
+	float hue[DETECT_HOPS * MAX_LANES], light[DETECT_HOPS * MAX_LANES];
+	uint32_t rgb[DETECT_HOPS * MAX_LANES];
+	osc_t osc[MAX_LANES];
+	double squared = 0, squared_original = 0, hue_err = 0, light_err = 0, elapsed = 0, start;
+	int k, j, l, n;
+	for (l = 0; l < lanes; l++) {
+		osc[l].phase = 0;
+	}
+	for (k = 0; k < steps; k += n) {
+		n = steps - k < DETECT_HOPS ? steps - k : DETECT_HOPS;
+		start = now();
+		for (j = 0; j < n; j++) {
+			for (l = 0; l < lanes; l++) {
+				float f, gain;
+				tone_table_entry(table, (k + j) * lanes + l, &f, &gain);
+				osc[l].tone = wavebank_tone(bank, f, gain);
+			}
+			// A pixel a frame longer than the hop spills into the next slot,
+			// which the next pixel then overwrites
+			render_tones(osc, lanes, hops + (size_t) j * hop_frames, hopclock_next(&clock));
+		}
+		if (lanes == 1) {
+			detector_pitch_batch(d, hops, n, freqs);
+			for (j = 0; j < n; j++) {
+				decode_hsl(freqs[j], render_peak(hops + (size_t) j * hop_frames, hop_frames, 0),
+						table->pitch_scale, table->lower_bounds, &hue[j], &light[j]);
+			}
+		} else {
+			for (j = 0; j < n; j++) {
+				detector_bands(d, hops + (size_t) j * hop_frames, lanes, freqs, amps);
+				for (l = 0; l < lanes; l++) {
+					float f = band_unspread(freqs[l], l, lanes, table->pitch_scale, table->lower_bounds);
+					decode_hsl(f, amps[l] * lanes, table->pitch_scale, table->lower_bounds,
+							&hue[j * lanes + l], &light[j * lanes + l]);
+				}
+			}
+		}
+		hsl_to_rgb_row(hue, light, n * lanes, &rgb_layout, rgb);
+		elapsed += now() - start;
+
+		for (j = 0; j < n * lanes; j++) {
+			unsigned int i = tone_table_pixel(table, k * lanes + j);
+			float dh = fmodf(fabsf(hue[j] - tonemap_hue(table->map, i)), 1);
+			hue_err += dh > 0.5f ? 1 - dh : dh;
+			light_err += fabsf(light[j] - (1 - tonemap_amp(table->map, i)));
+			squared += squared_error(unpack(rgb[j]), perfect[i]);
+			squared_original += squared_error(unpack(rgb[j]), original[i]);
+		}
+	}
+	r->psnr = psnr(squared, table->count);
+	r->psnr_original = psnr(squared_original, table->count);
+	r->hue_err = hue_err / table->count;
+	r->light_err = light_err / table->count;
+	r->pixels_per_sec = table->count / elapsed;
+}
+
+int main(int argc, char * argv[]) {
+	const char * default_images[] = { "face.png", "duck.png", "test.png", "test2.png" };
+	const char ** images = (const char **) malloc(argc * sizeof(char *));
+	int image_count = 0;
+	float ms_times[MAX_GRID] = { 0.5, 1, 2, 5, 10 }, scales[MAX_GRID] = { 5000, 10000, 20000 };
+	int ms_count = 5, scale_count = 3;
+	int lower_bounds = 1000;
+	unsigned int sample_rate = 44100;
+	enum TYPE waveform_type = Sine;
+	enum METHOD method = Fcomb;
+	int tone_lanes = 1;
+	double min_psnr = 0;
+	int i, m, s;
+	if (images == NULL) {
+		fprintf(stderr,"memory allocation failed\n");
+		exit(3);
+	}
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--ms")==0 && i + 1 < argc) {
+			ms_count = parse_list(argv[++i], ms_times, MAX_GRID);
+		} else if (strcmp(argv[i], "--scale")==0 && i + 1 < argc) {
+			scale_count = parse_list(argv[++i], scales, MAX_GRID);
+		} else if (strcmp(argv[i], "--lower")==0 && i + 1 < argc) {
+			lower_bounds = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--rate")==0 && i + 1 < argc) {
+			sample_rate = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--wave")==0 && i + 1 < argc) {
+			waveform_type = parse_waveform(argv[++i]);
+		} else if (strcmp(argv[i], "--detector")==0 && i + 1 < argc && parse_method(argv[i + 1]) >= 0) {
+			method = parse_method(argv[++i]);
+		} else if (strcmp(argv[i], "--tones")==0 && i + 1 < argc) {
+			tone_lanes = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--min-psnr")==0 && i + 1 < argc) {
+			min_psnr = atof(argv[++i]);
+		} else if (argv[i][0] != '-') {
+			images[image_count++] = argv[i];
+		} else {
+			fprintf(stderr, "usage: sonify-roundtrip [image path ...] [--ms <list>] [--scale <list>] [--lower <hz>] [--rate <hz>] [--wave <sin | sq | tri | saw>] [--detector <fcomb | fft>] [--tones <n>] [--min-psnr <db>]\ni.e. sonify-roundtrip face.png --ms 1,5,10 --scale 10000 --min-psnr 20\n");
+			exit(1);
+		}
+	}
+	if (image_count == 0) {
+		free(images);
+		images = default_images;
+		image_count = 4;
+	}
+	if (ms_count == 0 || scale_count == 0 || lower_bounds < 1 || sample_rate < 1 || tone_lanes < 1 || tone_lanes > MAX_LANES) {
+		fprintf(stderr, "bad option value\n");
+		exit(1);
+	}
+	// Only the FFT estimator can pull several tones out of one hop
+	if (tone_lanes > 1) {
+		method = Fft;
+	}
+
+	wavebank_t bank;
+	cache_init(cache_default_dir());
+	if (wavebank_build(&bank, sample_rate, waveform_type) != 0) {
+		fprintf(stderr,"memory allocation failed\n");
+		exit(3);
+	}
+	printf("render kernels: %s\n", render_init());
+	printf("%-12s %6s %7s %9s %9s %10s %8s %12s\n", "image", "ms", "scale", "PSNR dB", "orig dB", "hue err %", "L err %", "pixels/sec");
+	int failed = 0;
+	for (i = 0; i < image_count; i++) {
+		tonemap_t tone_map;
+		color * original, * perfect;
+		unsigned int p;
+		double squared = 0;
+		if (tonemap_open(&tone_map, images[i], NULL) != 0) {
+			exit(1);
+		}
+		if ((original = load_reference(images[i], &tone_map)) == NULL) {
+			exit(1);
+		}
+		// The best any setting can do, for scale
+		perfect = perfect_decode(&tone_map);
+		for (p = 0; p < tone_map.count; p++) {
+			squared += squared_error(perfect[p], original[p]);
+		}
+		printf("%-12s %6s %7s %9s %9.2f %10s %8s %12s\n", images[i], "-", "-", "-", psnr(squared, tone_map.count), "-", "-", "-");
+		// The shortest ms time that meets --min-psnr, at any scale
+		float best_ms = 0;
+		int best_scale = 0;
+		for (m = 0; m < ms_count; m++) {
+			hopclock_t clock;
+			hopclock_init(&clock, sample_rate, ms_times[m]);
+			unsigned int hop_frames = hopclock_frames(&clock);
+			sample_t * hops = (sample_t *) malloc(((size_t) DETECT_HOPS * hop_frames + 1) * sizeof(sample_t));
+			if (hops == NULL) {
+				fprintf(stderr,"memory allocation failed\n");
+				exit(3);
+			}
+			for (s = 0; s < scale_count; s++) {
+				int pitch_scale = scales[s];
+				tone_table_t tone_table;
+				detector_t d;
+				result_t r;
+				if (tone_table_init(&tone_table, &tone_map, 1, tone_lanes, pitch_scale, lower_bounds) == 0) {
+					fprintf(stderr, "%s has no pixels\n", images[i]);
+					exit(1);
+				}
+				if (detector_init(&d, method, sample_rate, hop_frames, lower_bounds, pitch_scale) != 0) {
+					fprintf(stderr, "cannot create pitch detector\n");
+					exit(1);
+				}
+				round_trip(&tone_table, &bank, &d, clock, perfect, original, hops, &r);
+				detector_free(&d);
+				printf("%-12s %6g %7d %9.2f %9.2f %10.3f %8.3f %12.0f%s\n", images[i], ms_times[m], pitch_scale, r.psnr,
+						r.psnr_original, 100 * r.hue_err, 100 * r.light_err, r.pixels_per_sec, r.psnr < min_psnr ? "  below" : "");
+				if (r.psnr < min_psnr) {
+					failed++;
+				} else if (best_ms == 0 || ms_times[m] < best_ms) {
+					best_ms = ms_times[m];
+					best_scale = pitch_scale;
+				}
+			}
+			free(hops);
+		}
+		if (min_psnr > 0) {
+			if (best_ms > 0) {
+				printf("%s: fastest at %g dB or better is %g ms at scale %d\n", images[i], min_psnr, best_ms, best_scale);
+			} else {
+				printf("%s: nothing reaches %g dB\n", images[i], min_psnr);
+			}
+		}
+		free(original);
+		free(perfect);
+		tonemap_close(&tone_map);
+	}
+	wavebank_free(&bank);
+	if (images != default_images) {
+		free(images);
+	}
+	// So a script can hold performance work to a quality bar
+	if (failed > 0) {
+		printf("%d configurations below %g dB\n", failed, min_psnr);
+		exit(2);
+	}
+	exit(0);
+}
@@ -0,0 +1,30 @@
+// sonify.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// Types shared by main.c and the modules it is built from.
+#ifndef SONIFY_H
+#define SONIFY_H
+
+#define PI 3.14159265358979323846
+
+// Same as jack_default_audio_sample_t, but usable without JACK headers
+typedef float sample_t;
+
+enum TYPE { Sine = 0, Square, Triangle, Sawtooth };
+
+#endif
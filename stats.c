@@ -0,0 +1,137 @@
+// stats.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "stats.h"
+
+stats_hist_t stats_hist[STAT_HISTS];
+uint64_t stats_count[STAT_COUNTS];
+
+static const char * hist_names[STAT_HISTS] = { "callback_ns", "tone_switch_ns", "hop_ns", "hop_fill", "pixel_fill" };
+static const char * count_names[STAT_COUNTS] = { "xruns", "dropped_hops", "tone_underruns" };
+
+// Exporter state
+static pthread_t exporter;
+static pthread_mutex_t stop_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stop_cond = PTHREAD_COND_INITIALIZER;
+static int running = 0;
+static FILE * out;
+static unsigned int period;
+static uint64_t started;
+
+// Upper edge of the bucket holding the `q` quantile, or the largest value
+// seen if that is lower
+static uint64_t quantile(const stats_hist_t * s, double q) {
+	uint64_t seen = 0, want = s->count * q, edge;
+	int b;
+	for (b = 0; b < STATS_BUCKETS - 1; b++) {
+		seen += s->bucket[b];
+		if (seen > want) {
+			break;
+		}
+	}
+	edge = ((uint64_t) 2 << b) - 1;
+	return b == STATS_BUCKETS - 1 || edge > s->max ? s->max : edge;
+}
+
+// One line of JSON with everything recorded so far. Totals only grow, so
+// a reader can diff two lines for the rate over that period.
+static void export_line() {
+	stats_hist_t s;
+	int h, b, last;
+	fprintf(out, "{\"t\":%.3f", (stats_now() - started) * 1e-9);
+	for (h = 0; h < STAT_COUNTS; h++) {
+		fprintf(out, ",\"%s\":%llu", count_names[h], (unsigned long long) stats_get(h));
+	}
+	for (h = 0; h < STAT_HISTS; h++) {
+		s.count = __atomic_load_n(&stats_hist[h].count, __ATOMIC_RELAXED);
+		s.sum = __atomic_load_n(&stats_hist[h].sum, __ATOMIC_RELAXED);
+		s.max = __atomic_load_n(&stats_hist[h].max, __ATOMIC_RELAXED);
+		last = 0;
+		for (b = 0; b < STATS_BUCKETS; b++) {
+			s.bucket[b] = __atomic_load_n(&stats_hist[h].bucket[b], __ATOMIC_RELAXED);
+			if (s.bucket[b] != 0) {
+				last = b + 1;
+			}
+		}
+		fprintf(out, ",\"%s\":{\"count\":%llu,\"mean\":%.0f,\"max\":%llu,\"p50\":%llu,\"p99\":%llu,\"log2\":[",
+				hist_names[h], (unsigned long long) s.count, s.count ? (double) s.sum / s.count : 0.0,
+				(unsigned long long) s.max, (unsigned long long) quantile(&s, 0.5),
+				(unsigned long long) quantile(&s, 0.99));
+		for (b = 0; b < last; b++) {
+			fprintf(out, b ? ",%llu" : "%llu", (unsigned long long) s.bucket[b]);
+		}
+		fprintf(out, "]}");
+	}
+	fprintf(out, "}\n");
+	fflush(out);
+}
+
+static void * export_main(void * arg) {
+	struct timeval now;
+	struct timespec until;
+	pthread_mutex_lock(&stop_lock);
+	while (running) {
+		gettimeofday(&now, NULL);
+		until.tv_sec = now.tv_sec + period / 1000;
+		until.tv_nsec = now.tv_usec * 1000 + (period % 1000) * 1000000;
+		if (until.tv_nsec >= 1000000000) {
+			until.tv_sec++;
+			until.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&stop_cond, &stop_lock, &until);
+		export_line();
+	}
+	pthread_mutex_unlock(&stop_lock);
+	return NULL;
+}
+
+int stats_start(const char * path, unsigned int period_ms) {
+	out = strcmp(path, "-") == 0 ? stdout : fopen(path, "a");
+	if (out == NULL) {
+		fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	period = period_ms;
+	started = stats_now();
+	running = 1;
+	if (pthread_create(&exporter, NULL, export_main, NULL) != 0) {
+		running = 0;
+		return -1;
+	}
+	return 0;
+}
+
+void stats_stop() {
+	pthread_mutex_lock(&stop_lock);
+	if (!running) {
+		pthread_mutex_unlock(&stop_lock);
+		return;
+	}
+	running = 0;
+	pthread_cond_signal(&stop_cond);
+	pthread_mutex_unlock(&stop_lock);
+	pthread_join(exporter, NULL);
+	if (out != stdout) {
+		fclose(out);
+	}
+}
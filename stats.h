@@ -0,0 +1,92 @@
+// stats.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// Counters and log2 histograms that process() and the worker threads can
+// update without locking or allocating, and a thread that writes them out
+// as one line of JSON every period. Each histogram has a single writer;
+// readers may see a sample half-recorded, which only skews one export.
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Bucket b counts values in [2^b, 2^(b+1)); 0 goes in bucket 0, and
+// anything past the last bucket in the last
+#define STATS_BUCKETS 32
+
+enum STAT_HIST {
+	StatCallback = 0,		// process(), ns
+	StatToneSwitch,			// select_tone(), ns
+	StatHop,			// pitch detection of one hop, all channels, ns
+	StatHopFill,			// hops waiting for the worker, per hop
+	StatPixelFill,			// pixels waiting for the GUI, per frame
+	STAT_HISTS
+};
+
+enum STAT_COUNT {
+	StatXruns = 0,
+	StatDroppedHops,
+	StatToneUnderruns,
+	STAT_COUNTS
+};
+
+typedef struct {
+	uint64_t count, sum, max;
+	uint64_t bucket[STATS_BUCKETS];
+} stats_hist_t;
+
+extern stats_hist_t stats_hist[STAT_HISTS];
+extern uint64_t stats_count[STAT_COUNTS];
+
+// Monotonic nanoseconds; a vDSO call, so fine for process()
+static inline uint64_t stats_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline void stats_record(enum STAT_HIST h, uint64_t v) {
+	stats_hist_t * s = &stats_hist[h];
+	int b = v == 0 ? 0 : 63 - __builtin_clzll(v);
+	if (b >= STATS_BUCKETS) {
+		b = STATS_BUCKETS - 1;
+	}
+	__atomic_fetch_add(&s->bucket[b], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&s->sum, v, __ATOMIC_RELAXED);
+	if (v > __atomic_load_n(&s->max, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&s->max, v, __ATOMIC_RELAXED);
+	}
+	__atomic_fetch_add(&s->count, 1, __ATOMIC_RELAXED);
+}
+
+static inline void stats_add(enum STAT_COUNT c, uint64_t n) {
+	__atomic_fetch_add(&stats_count[c], n, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t stats_get(enum STAT_COUNT c) {
+	return __atomic_load_n(&stats_count[c], __ATOMIC_RELAXED);
+}
+
+// Append a line to `path` ("-" for stdout) every `period_ms`, until
+// stats_stop(). Returns 0 on success.
+int stats_start(const char * path, unsigned int period_ms);
+// Write a last line and stop, if started
+void stats_stop();
+
+#endif
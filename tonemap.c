@@ -0,0 +1,477 @@
+// tonemap.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <png.h>
+// SDL Includes
+#include <SDL_image.h>
+#include <SDL.h>
+// 
+#include "tonemap.h"
+#include "cache.h"
+#include "math_util.h"
+#include "color_util.h"
+
+#define TONEMAP_HEADER_SIZE 64
+
+// Bytes R, G, B, X as libpng hands them to us, read as one Uint32
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static const hsl_layout_t png_layout = { 24, 16, 8, 0 };
+#else
+static const hsl_layout_t png_layout = { 0, 8, 16, 0 };
+#endif
+
+// A map being written by the producer thread: the image being decoded,
+// one row of hues and lightnesses, and a tile of quantized rows waiting to
+// be written out
+struct tonemap_build {
+	tonemap_t * map;
+	pthread_t thread;
+	int fd;
+	int cancel;			// set by tonemap_close()
+	int rc;
+	uint64_t hash;
+	char tmp[PATH_MAX];		// where it is being written
+	char path[PATH_MAX];		// where it goes when done, or "" to discard
+	unsigned int width, height;
+	// Source | A PNG read a row at a time, or an image SDL_image decoded
+	FILE * fp;
+	png_structp png;
+	png_infop info;
+	SDL_Surface * image;
+	hsl_layout_t layout;
+	// Buffers
+	float * hue, * light;
+	uint16_t * tile_hue;
+	uint8_t * tile_amp;
+	uint32_t * row;			// PNG only
+};
+
+typedef struct tonemap_build builder_t;
+
+static size_t amp_offset(size_t count) {
+	return TONEMAP_HEADER_SIZE + ((count * 2 + 63) & ~(size_t) 63);
+}
+
+static int write_all(int fd, const void * buf, size_t len, off_t offset) {
+	const char * p = (const char *) buf;
+	while (len > 0) {
+		ssize_t n = pwrite(fd, p, len, offset);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p += n;
+		len -= n;
+		offset += n;
+	}
+	return 0;
+}
+
+// Size the file and the buffers for a `width` x `height` image
+static int builder_start(builder_t * b, unsigned int width, unsigned int height) {
+	size_t count = (size_t) width * height;
+	if (width == 0 || height == 0 || count > UINT_MAX) {
+		fprintf(stderr, "cannot map a %u x %u image\n", width, height);
+		return -1;
+	}
+	b->width = width;
+	b->height = height;
+	b->hue = (float *) malloc(width * sizeof(float));
+	b->light = (float *) malloc(width * sizeof(float));
+	b->tile_hue = (uint16_t *) malloc((size_t) TONEMAP_TILE_ROWS * width * sizeof(uint16_t));
+	b->tile_amp = (uint8_t *) malloc((size_t) TONEMAP_TILE_ROWS * width);
+	b->row = (uint32_t *) malloc(width * sizeof(uint32_t));
+	if (b->hue == NULL || b->light == NULL || b->tile_hue == NULL || b->tile_amp == NULL || b->row == NULL) {
+		fprintf(stderr,"memory allocation failed\n");
+		return -1;
+	}
+	if (ftruncate(b->fd, amp_offset(count) + count) != 0) {
+		fprintf(stderr, "cannot size tone map: %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+// Quantize row `y` of packed pixels into the tile. When the tile is full
+// or the image ends, write it out and let the player at it.
+static int builder_row(builder_t * b, unsigned int y, const uint32_t * pixels, const hsl_layout_t * layout) {
+	unsigned int w = b->width, x;
+	unsigned int r = y % TONEMAP_TILE_ROWS;
+	uint16_t * hue = b->tile_hue + (size_t) r * w;
+	uint8_t * amp = b->tile_amp + (size_t) r * w;
+	hsl_from_rgb_row(pixels, w, layout, b->hue, b->light);
+	for (x = 0; x < w; x++) {
+		// Hues just below 1 round up to 65536, which wraps to red like 0
+		hue[x] = (uint16_t) (uint32_t) (b->hue[x] * 65536 + 0.5f);
+		amp[x] = (uint8_t) ((1 - b->light[x]) * 255 + 0.5f);
+	}
+	if (r == TONEMAP_TILE_ROWS - 1 || y == b->height - 1) {
+		size_t first = (size_t) (y - r) * w, n = (size_t) (r + 1) * w;
+		size_t count = (size_t) w * b->height;
+		if (write_all(b->fd, b->tile_hue, n * sizeof(uint16_t), TONEMAP_HEADER_SIZE + first * sizeof(uint16_t)) != 0 ||
+				write_all(b->fd, b->tile_amp, n, amp_offset(count) + first) != 0) {
+			fprintf(stderr, "cannot write tone map: %s\n", strerror(errno));
+			return -1;
+		}
+		// The mapping shares the page cache with pwrite(), so these rows
+		// are visible to whoever sees the new count
+		__atomic_store_n(&b->map->ready, first + n, __ATOMIC_RELEASE);
+	}
+	return 0;
+}
+
+// Release the source and the buffers; everything but the file
+static void builder_free(builder_t * b) {
+	if (b->png != NULL) {
+		png_destroy_read_struct(&b->png, &b->info, NULL);
+	}
+	if (b->fp != NULL) {
+		fclose(b->fp);
+	}
+	if (b->image != NULL) {
+		SDL_FreeSurface(b->image);
+	}
+	free(b->hue);
+	free(b->light);
+	free(b->tile_hue);
+	free(b->tile_amp);
+	free(b->row);
+	b->png = NULL;
+	b->info = NULL;
+	b->fp = NULL;
+	b->image = NULL;
+	b->hue = b->light = NULL;
+	b->tile_hue = NULL;
+	b->tile_amp = NULL;
+	b->row = NULL;
+}
+
+// Read the header of a non-interlaced PNG, leaving its rows for
+// png_rows(). Returns 1 if `b->fp` is not one, so the caller can fall back
+// to SDL_image.
+static int png_open(builder_t * b) {
+	png_byte sig[8];
+	if (fread(sig, 1, 8, b->fp) != 8 || png_sig_cmp(sig, 0, 8) != 0) {
+		return 1;
+	}
+	b->png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	b->info = b->png == NULL ? NULL : png_create_info_struct(b->png);
+	if (b->info == NULL) {
+		fprintf(stderr,"memory allocation failed\n");
+		return -1;
+	}
+	if (setjmp(png_jmpbuf(b->png))) {
+		// libpng has already said what went wrong
+		return -1;
+	}
+	png_init_io(b->png, b->fp);
+	png_set_sig_bytes(b->png, 8);
+	png_read_info(b->png, b->info);
+	// Interlaced rows are not final until the last pass
+	if (png_get_interlace_type(b->png, b->info) != PNG_INTERLACE_NONE) {
+		png_destroy_read_struct(&b->png, &b->info, NULL);
+		b->png = NULL;
+		b->info = NULL;
+		return 1;
+	}
+	// Whatever the color type and depth, read 8-bit R, G, B, X
+	png_set_expand(b->png);
+	png_set_strip_16(b->png);
+	png_set_gray_to_rgb(b->png);
+	png_set_filler(b->png, 0xff, PNG_FILLER_AFTER);
+	png_read_update_info(b->png, b->info);
+	return builder_start(b, png_get_image_width(b->png, b->info), png_get_image_height(b->png, b->info));
+}
+
+static int png_rows(builder_t * b) {
+	unsigned int y;
+	if (setjmp(png_jmpbuf(b->png))) {
+		return -1;
+	}
+	for (y = 0; y < b->height && !__atomic_load_n(&b->cancel, __ATOMIC_RELAXED); y++) {
+		png_read_row(b->png, (png_bytep) b->row, NULL);
+		if (builder_row(b, y, b->row, &png_layout) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// Everything else: decode the whole image up front, then map it the same
+// way
+static int sdl_open(builder_t * b, const char * path) {
+	SDL_Surface * image = IMG_Load(path);
+	if (image == NULL) {
+		fprintf(stderr, "Load failes: %s\n", IMG_GetError());
+		return -1;
+	}
+	b->image = image;
+	// hsl_from_rgb_row() wants whole 8-bit channels in 32-bit pixels
+	if (image->format->BytesPerPixel != 4 || image->format->Rloss || image->format->Gloss || image->format->Bloss) {
+		SDL_Surface * like = SDL_CreateRGBSurface(SDL_SWSURFACE, 1, 1, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0);
+		b->image = like ? SDL_ConvertSurface(image, like->format, SDL_SWSURFACE) : NULL;
+		if (like) {
+			SDL_FreeSurface(like);
+		}
+		SDL_FreeSurface(image);
+		if (b->image == NULL) {
+			fprintf(stderr, "ConvertSurface failed: %s\n", SDL_GetError());
+			return -1;
+		}
+	}
+	b->layout = surface_layout(b->image);
+	return builder_start(b, b->image->w, b->image->h);
+}
+
+static int sdl_rows(builder_t * b) {
+	SDL_Surface * image = b->image;
+	unsigned int y;
+	int rc = 0;
+	if SDL_MUSTLOCK(image) SDL_LockSurface(image);
+	for (y = 0; y < b->height && rc == 0 && !__atomic_load_n(&b->cancel, __ATOMIC_RELAXED); y++) {
+		rc = builder_row(b, y, (const uint32_t *) ((uint8_t *) image->pixels + y * image->pitch), &b->layout);
+	}
+	if SDL_MUSTLOCK(image) SDL_UnlockSurface(image);
+	return rc;
+}
+
+// The producer: convert every row, then write the header, which goes
+// last so a map cut short never looks valid, and move the map into place
+static void * produce(void * arg) {
+	builder_t * b = (builder_t *) arg;
+	tonemap_header_t header;
+	int rc = b->png != NULL ? png_rows(b) : sdl_rows(b);
+	int cancelled = __atomic_load_n(&b->cancel, __ATOMIC_RELAXED);
+	if (rc == 0 && !cancelled) {
+		memset(&header, 0, sizeof(tonemap_header_t));
+		memcpy(header.magic, TONEMAP_MAGIC, 8);
+		header.version = TONEMAP_VERSION;
+		header.width = b->width;
+		header.height = b->height;
+		header.source_hash = b->hash;
+		if (write_all(b->fd, &header, sizeof(tonemap_header_t), 0) != 0) {
+			fprintf(stderr, "cannot write tone map: %s\n", strerror(errno));
+			rc = -1;
+		}
+	}
+	if (b->path[0] != '\0') {
+		if (rc != 0 || cancelled) {
+			unlink(b->tmp);
+		} else if (rename(b->tmp, b->path) != 0) {
+			fprintf(stderr, "cannot save tone map to %s: %s\n", b->path, strerror(errno));
+			unlink(b->tmp);
+		}
+	}
+	// The rest of the file is zeros: let it play, silently
+	__atomic_store_n(&b->map->ready, b->map->count, __ATOMIC_RELEASE);
+	builder_free(b);
+	b->rc = rc;
+	return NULL;
+}
+
+// Map `size` bytes of `fd` holding a `width` x `height` map
+static int map_mem(tonemap_t * map, int fd, size_t size, unsigned int width, unsigned int height) {
+	size_t count = (size_t) width * height;
+	void * base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED) {
+		return -1;
+	}
+	// Playback walks the map front to back
+	madvise(base, size, MADV_SEQUENTIAL);
+	map->base = base;
+	map->size = size;
+	map->width = width;
+	map->height = height;
+	map->count = count;
+	map->hue = (const uint16_t *) ((const char *) base + TONEMAP_HEADER_SIZE);
+	map->amp = (const uint8_t *) base + amp_offset(count);
+	return 0;
+}
+
+// Map `fd` if it holds a whole map of the image whose contents hash to
+// `hash`
+static int map_fd(tonemap_t * map, int fd, uint64_t hash) {
+	tonemap_header_t header;
+	struct stat ms;
+	size_t count;
+	if (fstat(fd, &ms) != 0 || ms.st_size < TONEMAP_HEADER_SIZE ||
+			pread(fd, &header, sizeof(tonemap_header_t), 0) != sizeof(tonemap_header_t)) {
+		return -1;
+	}
+	count = (size_t) header.width * header.height;
+	if (memcmp(header.magic, TONEMAP_MAGIC, 8) != 0 || header.version != TONEMAP_VERSION ||
+			count == 0 || count > UINT_MAX || (size_t) ms.st_size != amp_offset(count) + count ||
+			header.source_hash != hash) {
+		return -1;
+	}
+	if (map_mem(map, fd, ms.st_size, header.width, header.height) != 0) {
+		return -1;
+	}
+	map->ready = map->count;
+	return 0;
+}
+
+int tonemap_start(tonemap_t * map, const char * image_path, const char * map_path) {
+	char cached[PATH_MAX], name[64];
+	const char * dir;
+	builder_t * b;
+	uint64_t hash;
+	int fd, rc;
+	memset(map, 0, sizeof(tonemap_t));
+	if (cache_file_hash(image_path, &hash) != 0) {
+		return -1;
+	}
+	snprintf(name, sizeof(name), "%016llx.tonemap", (unsigned long long) hash);
+	if (map_path == NULL && cache_path(cached, sizeof(cached), name) == 0) {
+		map_path = cached;
+	}
+	if (map_path != NULL) {
+		fd = open(map_path, O_RDONLY);
+		if (fd >= 0) {
+			rc = map_fd(map, fd, hash);
+			close(fd);
+			if (rc == 0) {
+				return 0;
+			}
+		}
+	}
+	b = (builder_t *) calloc(1, sizeof(builder_t));
+	if (b == NULL) {
+		fprintf(stderr,"memory allocation failed\n");
+		return -1;
+	}
+	b->map = map;
+	b->hash = hash;
+	// Build beside the final name and rename into place, so nobody maps
+	// half a file
+	if (map_path != NULL) {
+		snprintf(b->path, sizeof(b->path), "%s", map_path);
+		snprintf(b->tmp, sizeof(b->tmp), "%s.XXXXXX", map_path);
+	} else {
+		dir = getenv("TMPDIR");
+		snprintf(b->tmp, sizeof(b->tmp), "%s/sonify-XXXXXX", dir != NULL ? dir : "/tmp");
+	}
+	b->fd = mkstemp(b->tmp);
+	if (b->fd < 0) {
+		fprintf(stderr, "cannot create %s: %s\n", b->tmp, strerror(errno));
+		free(b);
+		return -1;
+	}
+	if (map_path == NULL) {
+		unlink(b->tmp);
+	}
+	// Learn the image's size now; decode its rows on the producer
+	b->fp = fopen(image_path, "rb");
+	if (b->fp == NULL) {
+		fprintf(stderr, "cannot open %s: %s\n", image_path, strerror(errno));
+		rc = -1;
+	} else {
+		rc = png_open(b);
+		if (rc == 1) {
+			fclose(b->fp);
+			b->fp = NULL;
+			rc = sdl_open(b, image_path);
+		}
+	}
+	if (rc == 0 && map_mem(map, b->fd, amp_offset((size_t) b->width * b->height) + (size_t) b->width * b->height,
+				b->width, b->height) != 0) {
+		fprintf(stderr, "cannot map tone map: %s\n", strerror(errno));
+		rc = -1;
+	}
+	if (rc == 0 && pthread_create(&b->thread, NULL, produce, b) != 0) {
+		fprintf(stderr, "cannot start tone map producer\n");
+		rc = -1;
+	}
+	if (rc != 0) {
+		builder_free(b);
+		close(b->fd);
+		if (map_path != NULL) {
+			unlink(b->tmp);
+		}
+		free(b);
+		tonemap_close(map);
+		return -1;
+	}
+	map->build = b;
+	return 0;
+}
+
+int tonemap_finish(tonemap_t * map) {
+	builder_t * b = map->build;
+	int rc;
+	if (b == NULL) {
+		return 0;
+	}
+	pthread_join(b->thread, NULL);
+	rc = b->rc;
+	close(b->fd);
+	free(b);
+	map->build = NULL;
+	return rc;
+}
+
+int tonemap_open(tonemap_t * map, const char * image_path, const char * map_path) {
+	if (tonemap_start(map, image_path, map_path) != 0) {
+		return -1;
+	}
+	if (tonemap_finish(map) != 0) {
+		tonemap_close(map);
+		return -1;
+	}
+	return 0;
+}
+
+static void willneed(const void * p, size_t len) {
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t) p & ~(page - 1);
+	madvise((void *) start, (uintptr_t) p + len - start, MADV_WILLNEED);
+}
+
+void tonemap_willneed(const tonemap_t * map, unsigned int first, unsigned int n) {
+	if (first >= map->count || n == 0) {
+		return;
+	}
+	if (n > map->count - first) {
+		n = map->count - first;
+	}
+	willneed(map->hue + first, n * sizeof(uint16_t));
+	willneed(map->amp + first, n);
+}
+
+void tonemap_close(tonemap_t * map) {
+	if (map->build != NULL) {
+		__atomic_store_n(&map->build->cancel, 1, __ATOMIC_RELAXED);
+		tonemap_finish(map);
+	}
+	if (map->base != NULL) {
+		munmap(map->base, map->size);
+	}
+	memset(map, 0, sizeof(tonemap_t));
+}
@@ -0,0 +1,106 @@
+// tonemap.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// The quantized hue and amplitude of every pixel of an image, stored
+// struct-of-arrays in a file and mapped read-only: 3 bytes a pixel, paged
+// in as playback reaches it. A new map is built by a producer thread while
+// the image plays: PNGs are decoded a tile of rows at a time, so building
+// never holds the whole image in memory, and `ready` says how far it has
+// got. Other formats are decoded whole by SDL_image first.
+//
+// Either way the map is built top to bottom, because that is the only
+// order libpng can hand rows over in. With --channels N each channel plays
+// its own horizontal stripe of the image (tones.h), so stripe c cannot
+// start until the rows above it are built: the engine keeps a stripe the
+// producer has not reached silent, rather than counting it as an
+// underrun, and brings it in at the playhead once it has. On a big image
+// the lower channels may therefore join a few seconds late.
+#ifndef TONEMAP_H
+#define TONEMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct tonemap_build;
+
+#define TONEMAP_MAGIC "SONIFYTM"
+#define TONEMAP_VERSION 2
+// Rows decoded and written per step of the build
+#define TONEMAP_TILE_ROWS 16
+
+// The file starts with this, padded to 64 bytes; `hue` follows it and
+// `amp` starts at the next 64-byte boundary after that
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t width, height;
+	uint32_t pad;
+	uint64_t source_hash;		// cache_file_hash() of the image it came from
+} tonemap_header_t;
+
+typedef struct {
+	void * base;
+	size_t size;
+	unsigned int width, height, count;
+	const uint16_t * hue;		// hue * 65536
+	const uint8_t * amp;		// (1 - lightness) * 255
+	unsigned int ready;		// pixels built so far; read with tonemap_ready()
+	struct tonemap_build * build;	// the producer, while it runs
+} tonemap_t;
+
+// Map the tones of the image at `image_path`. With a `map_path`, reuse the
+// map there if it was built from the same contents, or build it there for
+// next time. Without one, do the same in the cache (cache.h), or failing
+// that build into an unlinked temporary file. Returns 0 on success, -1
+// after printing why not.
+int tonemap_open(tonemap_t * map, const char * image_path, const char * map_path);
+// The same, but return as soon as the image's size is known and leave the
+// producer building the rest
+int tonemap_start(tonemap_t * map, const char * image_path, const char * map_path);
+// Wait for the producer. Returns 0 if the whole map was built.
+int tonemap_finish(tonemap_t * map);
+// Stops the producer if it is still running
+void tonemap_close(tonemap_t * map);
+
+// Ask the kernel to start reading pixels [first, first + n) from disk.
+// May block briefly, so call it from anywhere but process().
+void tonemap_willneed(const tonemap_t * map, unsigned int first, unsigned int n);
+
+// Pixels [0, tonemap_ready()) may be played. Safe to call from process().
+static inline unsigned int tonemap_ready(const tonemap_t * map) {
+	return __atomic_load_n(&map->ready, __ATOMIC_ACQUIRE);
+}
+
+// Hue in [0, 1) and amplitude in [0, 1] of pixel `i`
+static inline float tonemap_hue(const tonemap_t * map, unsigned int i) {
+	return map->hue[i] * (1.0f / 65536);
+}
+
+static inline float tonemap_amp(const tonemap_t * map, unsigned int i) {
+	return map->amp[i] * (1.0f / 255);
+}
+
+// Start pulling pixel `i` into the cache ahead of use
+static inline void tonemap_prefetch(const tonemap_t * map, unsigned int i) {
+	if (i < map->count) {
+		__builtin_prefetch(map->hue + i);
+		__builtin_prefetch(map->amp + i);
+	}
+}
+
+#endif
@@ -0,0 +1,47 @@
+// tones.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <string.h>
+#include "tones.h"
+
+int tone_table_init(tone_table_t * table, const tonemap_t * map, int channels, int lanes,
+		int pitch_scale, int lower_bounds) {
+	int width = map->width, rows = map->height / channels, stripe;
+	// Each stripe is a whole number of steps and of rows, so every channel
+	// starts at the left edge of a row
+	while (rows > 0 && rows * width % lanes != 0) {
+		rows--;
+	}
+	stripe = rows * width;
+	table->map = map;
+	table->channels = channels;
+	table->lanes = lanes;
+	table->stripe = stripe;
+	table->count = stripe * channels;
+	table->pitch_scale = pitch_scale;
+	table->lower_bounds = lower_bounds;
+	table->feedback = NULL;
+	return table->count;
+}
+
+enum TYPE parse_waveform(const char * name) {
+	if (strcmp(name, "sin")==0) { return Sine; }
+	else if (strcmp(name, "sq")==0) { return Square; }
+	else if (strcmp(name, "tri")==0) { return Triangle; }
+	else { return Sawtooth; }
+}
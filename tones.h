@@ -0,0 +1,91 @@
+// tones.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// The order in which the pixels of a tone map (tonemap.h) are played,
+// and the frequency and gain each one plays at
+#ifndef TONES_H
+#define TONES_H
+
+#include "sonify.h"
+#include "tonemap.h"
+#include "feedback.h"
+#include "bands.h"
+
+typedef struct {
+	const tonemap_t * map;
+	int channels, lanes;
+	int stripe;			// pixels in each channel's stripe
+	int count;			// entries: stripe * channels
+	int pitch_scale, lower_bounds;
+	const feedback_t * feedback;	// if set, play this rather than `map`
+} tone_table_t;
+
+// Multichannel | Play the pixels of `map` as `channels` horizontal stripes
+// of equal height, side by side: each step of the table holds the next
+// `lanes` pixels of every stripe in turn, entry (k * channels + c) * lanes
+// + l being pixel l of step k of stripe c. Rows that do not divide
+// evenly are dropped, and with several lanes up to lanes - 1 more from
+// each stripe, so that it holds a whole number of steps. Returns the
+// number of entries, 0 if the image is too short for that.
+int tone_table_init(tone_table_t * table, const tonemap_t * map, int channels, int lanes,
+		int pitch_scale, int lower_bounds);
+
+// Pixel of the image behind entry `e`
+static inline unsigned int tone_table_pixel(const tone_table_t * table, int e) {
+	int l = e % table->lanes, group = e / table->lanes;
+	return (group % table->channels) * table->stripe + (group / table->channels) * table->lanes + l;
+}
+
+// Hue and amplitude of pixel `i`, from the feedback buffers if there are
+// any
+static inline void tone_table_source(const tone_table_t * table, unsigned int i, float * hue, float * amp) {
+	if (table->feedback != NULL) {
+		feedback_tone(table->feedback, i, hue, amp);
+	} else {
+		*hue = tonemap_hue(table->map, i);
+		*amp = tonemap_amp(table->map, i);
+	}
+}
+
+// Frequency and gain of entry `e`: hue = frequency, luminosity =
+// amplitude. In multi-tone mode each pixel moves into the sub-band for its
+// lane and shares its gain between the lanes, so their sum stays in range;
+// see bands.h.
+static inline void tone_table_entry(const tone_table_t * table, int e, float * f, float * gain) {
+	unsigned int i = tone_table_pixel(table, e);
+	float hue, amp;
+	tone_table_source(table, i, &hue, &amp);
+	if (table->lanes > 1) {
+		*f = band_tone(hue, e % table->lanes, table->lanes, table->pitch_scale, table->lower_bounds);
+	} else {
+		*f = hue * table->pitch_scale + table->lower_bounds;
+	}
+	*gain = amp / table->lanes;
+}
+
+// Warm the cache for entry `e`
+static inline void tone_table_prefetch(const tone_table_t * table, int e) {
+	if (e < table->count) {
+		tonemap_prefetch(table->map, tone_table_pixel(table, e));
+	}
+}
+
+// "sin", "sq", "tri", anything else is a sawtooth
+enum TYPE parse_waveform(const char * name);
+
+#endif
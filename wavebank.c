@@ -0,0 +1,145 @@
+// wavebank.c
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "wavebank.h"
+#include "cache.h"
+
+#define WAVEBANK_SAMPLES (WAVEBANK_LEVELS * (WAVEBANK_TABLE_SIZE + 1))
+
+// Fourier series of each waveform, truncated to `harmonics` partials.
+// These match the naive cycles build_tone() used to compute: the square
+// and triangle start rising from 0, the sawtooth rises from -1 to 1.
+static void render_level(sample_t * dst, int harmonics, enum TYPE type) {
+	int i, k;
+	float peak = 0;
+	for (i = 0; i < WAVEBANK_TABLE_SIZE; i++) {
+		double x = 2 * PI * i / WAVEBANK_TABLE_SIZE;
+		double v = 0;
+		switch(type) {
+			case Sine:
+				v = sin(x);
+				break;
+			case Square:
+				for (k = 1; k <= harmonics; k += 2) {
+					v += sin(k * x) / k;
+				}
+				break;
+			case Triangle:
+				for (k = 1; k <= harmonics; k += 2) {
+					v += ((k / 2) % 2 ? -1 : 1) * sin(k * x) / ((double) k * k);
+				}
+				break;
+			case Sawtooth:
+				for (k = 1; k <= harmonics; k++) {
+					v -= sin(k * x) / k;
+				}
+				break;
+		}
+		dst[i] = v;
+		if (fabs(v) > peak) {
+			peak = fabs(v);
+		}
+	}
+	// Normalize so that gain is the peak amplitude, whatever the waveform
+	for (i = 0; i < WAVEBANK_TABLE_SIZE; i++) {
+		dst[i] /= peak;
+	}
+	dst[WAVEBANK_TABLE_SIZE] = dst[0];
+}
+
+tone_t wavebank_tone(const wavebank_t * bank, float f, float gain) {
+	tone_t tone;
+	float nyquist = bank->sample_rate / 2.0;
+	int l = 0;
+	if (f < 0) {
+		f = 0;
+	}
+	// Highest level whose top harmonic stays below Nyquist
+	while (l < WAVEBANK_LEVELS - 1 && ((WAVEBANK_TABLE_SIZE / 2) >> l) * f > nyquist) {
+		l++;
+	}
+	tone.step = (uint32_t) (f / bank->sample_rate * 4294967296.0 + 0.5);
+	tone.gain = gain;
+	tone.table = bank->tables + l * (WAVEBANK_TABLE_SIZE + 1);
+	return tone;
+}
+
+// Cache | The tables depend only on the waveform and the table size
+static int load_tables(const char * path, sample_t * tables) {
+	FILE * fp = fopen(path, "rb");
+	int rc;
+	if (fp == NULL) {
+		return -1;
+	}
+	rc = fread(tables, sizeof(sample_t), WAVEBANK_SAMPLES, fp) == WAVEBANK_SAMPLES && fgetc(fp) == EOF;
+	fclose(fp);
+	return rc ? 0 : -1;
+}
+
+static void store_tables(const char * path, const sample_t * tables) {
+	char tmp[PATH_MAX];
+	FILE * fp;
+	int fd, rc;
+	if ((size_t) snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= sizeof(tmp) || (fd = mkstemp(tmp)) < 0) {
+		return;
+	}
+	fp = fdopen(fd, "wb");
+	if (fp == NULL) {
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+	rc = fwrite(tables, sizeof(sample_t), WAVEBANK_SAMPLES, fp) == WAVEBANK_SAMPLES;
+	if (fclose(fp) != 0 || !rc || rename(tmp, path) != 0) {
+		unlink(tmp);
+	}
+}
+
+int wavebank_build(wavebank_t * bank, unsigned int sample_rate, enum TYPE type) {
+	char path[PATH_MAX], name[64];
+	int i, cached;
+	memset(bank, 0, sizeof(wavebank_t));
+	bank->tables = (sample_t *) malloc(WAVEBANK_SAMPLES * sizeof(sample_t));
+	if (bank->tables == NULL) {
+		return -1;
+	}
+	bank->sample_rate = sample_rate;
+	snprintf(name, sizeof(name), "wavetable-%d-%d-%d.f32", (int) type, WAVEBANK_TABLE_BITS, (int) sizeof(sample_t));
+	cached = cache_path(path, sizeof(path), name) == 0;
+	if (cached && load_tables(path, bank->tables) == 0) {
+		return 0;
+	}
+	for (i = 0; i < WAVEBANK_LEVELS; i++) {
+		render_level(bank->tables + i * (WAVEBANK_TABLE_SIZE + 1), (WAVEBANK_TABLE_SIZE / 2) >> i, type);
+	}
+	if (cached) {
+		store_tables(path, bank->tables);
+	}
+	return 0;
+}
+
+void wavebank_free(wavebank_t * bank) {
+	free(bank->tables);
+	memset(bank, 0, sizeof(wavebank_t));
+}
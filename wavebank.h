@@ -0,0 +1,71 @@
+// wavebank.h
+/* Copyright (C) 2010 Mark Roberts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+// Band-limited wavetables, and the tones that play them, so that process()
+// only ever has to swap a few values between pixels.
+#ifndef WAVEBANK_H
+#define WAVEBANK_H
+
+#include <stdint.h>
+#include "sonify.h"
+
+// One cycle per table, plus a guard sample for interpolation. Level `l`
+// holds harmonics up to (WAVEBANK_TABLE_SIZE / 2) >> l, so each level is
+// good for an octave of fundamentals below the Nyquist frequency.
+#define WAVEBANK_TABLE_BITS 11
+#define WAVEBANK_TABLE_SIZE (1 << WAVEBANK_TABLE_BITS)
+#define WAVEBANK_LEVELS WAVEBANK_TABLE_BITS
+#define WAVEBANK_FRAC_BITS (32 - WAVEBANK_TABLE_BITS)
+
+// Everything the oscillator needs to play one pixel
+typedef struct {
+	uint32_t step;			// phase increment per frame; 2^32 is one cycle
+	float gain;
+	const sample_t * table;		// mip level suited to this frequency
+} tone_t;
+
+typedef struct {
+	sample_t * tables;		// WAVEBANK_LEVELS tables of WAVEBANK_TABLE_SIZE + 1 samples
+	unsigned int sample_rate;
+} wavebank_t;
+
+// Fractional phase accumulator. `phase` carries over from one tone to the
+// next so that pixel changes do not click.
+typedef struct {
+	uint32_t phase;
+	tone_t tone;
+} osc_t;
+
+// Build band-limited tables for waveform `type`, or load them from the
+// cache (cache.h). Returns 0 on success, -1 if out of memory.
+int wavebank_build(wavebank_t * bank, unsigned int sample_rate, enum TYPE type);
+void wavebank_free(wavebank_t * bank);
+
+// Tone for frequency `f` at gain `gain`. Cheap, and safe to call from
+// process(): no allocation and no libm.
+tone_t wavebank_tone(const wavebank_t * bank, float f, float gain);
+
+static inline sample_t osc_tick(osc_t * osc) {
+	uint32_t i = osc->phase >> WAVEBANK_FRAC_BITS;
+	float frac = (osc->phase & ((1u << WAVEBANK_FRAC_BITS) - 1)) * (1.0f / (1u << WAVEBANK_FRAC_BITS));
+	const sample_t * t = osc->tone.table;
+	osc->phase += osc->tone.step;
+	return (t[i] + frac * (t[i + 1] - t[i])) * osc->tone.gain;
+}
+
+#endif